@@ -16,6 +16,7 @@
 
 #include "ofApp.h"
 #include "Primitives.h"
+#include <atomic>
 
 
 // // // INTERSECTION FUNCTIONS // // //
@@ -23,10 +24,10 @@
 
 bool Sphere::intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, glm::vec3 &rendCamPos) {
 
-	// transform Ray to object space.  
+	// transform Ray to object space (cached matrices, see SceneObject::updateMatrix)
 	//
-	glm::mat4 m = getMatrix();
-	glm::mat4 mInv = glm::inverse(m);
+	const glm::mat4 &m = worldMatrix;
+	const glm::mat4 &mInv = worldInverse;
 	glm::vec4 p = mInv * glm::vec4(ray.p.x, ray.p.y, ray.p.z, 1.0);
 	glm::vec4 p1 = mInv * glm::vec4(ray.p + ray.d, 1.0);
 	glm::vec3 d = glm::normalize(p1 - p);
@@ -52,39 +53,30 @@ bool Sphere::intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, glm:
 //
 bool Cube::intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, glm::vec3 &rendCamPos) {
 
-	// transform Ray to object space.  
-	//
-	glm::mat4 m = getMatrix();
-	glm::mat4 mInv = glm::inverse(m);
-	glm::vec4 p = mInv * glm::vec4(ray.p.x, ray.p.y, ray.p.z, 1.0);
-	glm::vec4 p1 = mInv * glm::vec4(ray.p + ray.d, 1.0);
-	glm::vec3 d = glm::normalize(p1 - p);
-
-
-	// intesect method we use will be Willam's  (see box.h and box.cc for reference).
-	// note that this class has it's own version of Ray, Vector3  (TBD: port to GLM)
+	// transform Ray to object space (cached matrices, see SceneObject::updateMatrix)
+	// the direction is not renormalized, the hit point does not depend on it
 	//
-	_Ray boxRay = _Ray(Vector3(p.x, p.y, p.z), Vector3(d.x, d.y, d.z));
+	const glm::mat4 &m = worldMatrix;
+	const glm::mat4 &mInv = worldInverse;
+	Ray boxRay = Ray(mInv * glm::vec4(ray.p, 1.0), mInv * glm::vec4(ray.d, 0.0));
 
+	// intesect method we use will be Willam's  (see AABB::intersect and ray.h for reference).
 	// we will test for intersection in object space (object is a "unit" cube edge is len=2)
 	//
-	Box box = Box(Vector3(-width/2.0, -height/2.0, -depth/2.0), Vector3(width/2.0, height/2.0, depth/2.0));
-
-	Vector3 pt, nm;
+	AABB box = AABB(glm::vec3(-width / 2, -height / 2, -depth / 2), glm::vec3(width / 2, height / 2, depth / 2));
 
 	//calculates the POI & normal
-	bool hit = box.intersect(boxRay, pt, nm, -1000, 1000);
+	Hit hit;
+	if (!box.intersect(boxRay, hit, -1000, 1000))
+		return false;
 
 	// ***
 	// transform point and normal to world space
 	//
-	if (hit) {		
-		point = glm::vec3(pt[0], pt[1], pt[2]);
-		point = m * glm::vec4(point, 1.0);
-		normal = glm::vec4(nm[0], nm[1], nm[2], 1.0) * mInv;
-	}
+	point = m * glm::vec4(hit.point, 1.0);
+	normal = glm::vec4(hit.normal, 1.0) * mInv;
 
-	return hit;
+	return true;
 }
 
 
@@ -92,55 +84,31 @@ bool Cube::intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, glm::v
 // Determines if ray intersects mesh
 // Returns point of intersection and face normal
 // Currently does not support smooth shading
+// The nearest front facing triangle is found through the mesh BVH
 //
 bool Mesh::intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, glm::vec3 &rendCamPos) {
 	
-	// transform Ray to object space.  
+	// transform Ray to object space (cached matrices, see SceneObject::updateMatrix)
 	//
-	glm::mat4 m = getMatrix();
-	glm::mat4 mInv = glm::inverse(m);
+	const glm::mat4 &m = worldMatrix;
+	const glm::mat4 &mInv = worldInverse;
 	glm::vec4 p0 = mInv * glm::vec4(ray.p.x, ray.p.y, ray.p.z, 1.0);
 	glm::vec4 p1 = mInv * glm::vec4(ray.p + ray.d, 1.0);
 	glm::vec3 p = p0; //DO NOT NORMALIZE
 	glm::vec3 d = glm::normalize(p1 - p0);
-	glm::vec3 r = mInv * glm::vec4(rendCamPos, 1.0);
-
-	bool anyHit = false, hit;
-	float near_dist = std::numeric_limits<float>::infinity(), dist, front;
-	glm::vec3 bary, pt, nm, v0, v1, v2;
-
-	for (int i = 0; i < faces.size(); i++) {
-		hit = false;
-		v0 = faces[i].getVertex(0);
-		v1 = faces[i].getVertex(1);
-		v2 = faces[i].getVertex(2);
-		nm = faces[i].getFaceNormal();
-
-		hit = glm::intersectRayTriangle(p, d, v0, v1, v2, bary);
-		front = glm::dot(d, nm);
-
-		if (hit && front < 0) {
-			pt = p + bary.z * d;
-			dist = glm::length(pt - r);
-			if (dist < near_dist) {
-				near_dist = dist;
-				point = pt;
-				normal = faces[i].getFaceNormal();
-
-				//calculate the interpolated normal for shading
-				
-			}
-			anyHit = true;
-		}
-	}
 
-	if (anyHit) {
-		//convert to world space
-		point = m * glm::vec4(point, 1.0);
-		normal = glm::vec4(normal, 1.0) * mInv;
-	}
+	float t;
+	int face;
+	glm::vec3 n;
+
+	if (!geometry->bvh.intersect(p, d, t, face, n))
+		return false;
 
-	return anyHit;
+	//convert to world space
+	point = m * glm::vec4(p + t * d, 1.0);
+	normal = glm::vec4(n, 1.0) * mInv;
+
+	return true;
 }
 
 
@@ -224,7 +192,7 @@ void Mesh::draw() {
 	//
 	ofPushMatrix();
 	ofMultMatrix(m);
-	mesh.draw();
+	geometry->mesh.draw();
 	ofPopMatrix();
 
 	//  draw axis
@@ -235,12 +203,11 @@ void Mesh::draw() {
 
 //  Uses OF plane primitive
 //
+//  *** the primitive is sized once in the constructor, drawing does not change the plane
+//
 void Plane::draw() {
 	material.begin();
 	material.setDiffuseColor(diffuseColor);
-	plane.setWidth(width);
-	plane.setHeight(height);
-	plane.setResolution(5, 5);
 	plane.draw();
 	material.end();
 }
@@ -301,7 +268,7 @@ void Mesh::drawEdges() {
 	//
 	ofPushMatrix();
 	ofMultMatrix(m);
-	mesh.drawWireframe();
+	geometry->mesh.drawWireframe();
 	ofPopMatrix();
 
 	//  draw axis
@@ -313,9 +280,6 @@ void Mesh::drawEdges() {
 //  ***
 void Plane::drawEdges() {
 	material.begin();
-	plane.setWidth(width);
-	plane.setHeight(height);
-	plane.setResolution(5, 5);
 	plane.drawWireframe();
 	material.end();
 }
@@ -324,6 +288,324 @@ void Plane::drawEdges() {
 // // // SCENE OBJECT FUNCTION // // //
 
 
+//  ***
+//  the local matrix is trans * post * rotate * pre * scale (see getLocalMatrix)
+//  which is built and inverted analytically:
+//		M    = [ R S | t ]					t = position + pivot - R * pivot
+//		M^-1 = [ S^-1 R^T | -S^-1 R^T t ]
+//  the world matrices are then parent * M and M^-1 * parent^-1
+//
+void SceneObject::updateMatrix() {
+	static std::atomic<unsigned long> nextStamp(0);		// snapshots of animation frames are built on the render threads
+
+	unsigned long ps = 0;
+	if (parent) {
+		parent->updateMatrix();
+		ps = parent->stamp;
+	}
+
+	if (stamp && position == cachedPosition && rotation == cachedRotation && scale == cachedScale &&
+		pivot == cachedPivot && parent == cachedParent && ps == parentStamp)
+		return;
+
+	glm::mat3 R = glm::mat3(getRotateMatrix());
+	glm::vec3 t = position + pivot - R * pivot;
+	glm::vec3 invS = 1.0f / scale;
+
+	glm::mat4 local = glm::mat4(1.0), localInv = glm::mat4(1.0);
+	for (int c = 0; c < 3; c++) {
+		local[c] = glm::vec4(R[c] * scale[c], 0);
+		for (int r = 0; r < 3; r++)
+			localInv[c][r] = R[r][c] * invS[r];		// row r of R^T scaled by 1 / scale[r]
+	}
+	local[3] = glm::vec4(t, 1);
+	localInv[3] = glm::vec4(-(glm::mat3(localInv) * t), 1);
+
+	if (parent) {
+		worldMatrix = parent->worldMatrix * local;
+		worldInverse = localInv * parent->worldInverse;
+	}
+	else {
+		worldMatrix = local;
+		worldInverse = localInv;
+	}
+
+	cachedPosition = position;
+	cachedRotation = rotation;
+	cachedScale = scale;
+	cachedPivot = pivot;
+	cachedParent = parent;
+	parentStamp = ps;
+	stamp = ++nextStamp;
+}
+
+
+//  ***
+//  per channel, the most recent key at or before frame holds its value until the next
+//  key of that channel, in between the value is eased by the first key's function
+//
+void SceneObject::evalFrame(int frame, bool interpolate) {
+	glm::vec3 *values[Keyframe::NUM_CHANNELS] = { &position, &rotation, &scale, &pivot };
+
+	for (int c = 0; c < Keyframe::NUM_CHANNELS; c++) {
+		const Keyframe *start, *end;
+		keys.bracket(c, frame, start, end);
+		if (!start) continue;
+
+		if (!end || !interpolate || start->frame == frame) {
+			*values[c] = start->channel(c);
+			continue;
+		}
+
+		float ratio = start->ease((float)(frame - start->frame) / (end->frame - start->frame));
+		*values[c] = start->channel(c) + (end->channel(c) - start->channel(c)) * ratio;
+	}
+}
+
+
+// // // POOLED ALLOCATION // // //
+
+
+//  the pools only align blocks to BlockPool::alignment
+//
+static_assert(alignof(Keyframe) <= BlockPool::alignment, "Keyframe is over-aligned for its pool");
+static_assert(alignof(Cube) <= BlockPool::alignment, "Cube is over-aligned for its pool");
+static_assert(alignof(Sphere) <= BlockPool::alignment, "Sphere is over-aligned for its pool");
+static_assert(alignof(Mesh) <= BlockPool::alignment, "Mesh is over-aligned for its pool");
+static_assert(alignof(Plane) <= BlockPool::alignment, "Plane is over-aligned for its pool");
+static_assert(alignof(ViewPlane) <= BlockPool::alignment, "ViewPlane is over-aligned for its pool");
+static_assert(alignof(RenderCam) <= BlockPool::alignment, "RenderCam is over-aligned for its pool");
+static_assert(alignof(QuadArea) <= BlockPool::alignment, "QuadArea is over-aligned for its pool");
+static_assert(alignof(Light) <= BlockPool::alignment, "Light is over-aligned for its pool");
+
+
+//  ***
+//  one pool for the objects and one for the keys, never destroyed so objects that
+//  are deleted during shutdown (render snapshots) can still give their blocks back
+//
+BlockPool &SceneObject::pool() {
+	static BlockPool *objects = new BlockPool();
+	return *objects;
+}
+
+
+BlockPool &Keyframe::pool() {
+	static BlockPool *keys = new BlockPool(256);
+	return *keys;
+}
+
+
+void *SceneObject::operator new(size_t size) {
+	return pool().allocate(size);
+}
+
+
+void SceneObject::operator delete(void *p, size_t size) {
+	pool().deallocate(p, size);
+}
+
+
+void *Keyframe::operator new(size_t size) {
+	return pool().allocate(size);
+}
+
+
+void Keyframe::operator delete(void *p, size_t size) {
+	pool().deallocate(p, size);
+}
+
+
+// // // KEYFRAME TRACK FUNCTIONS // // //
+
+
+// first key after frame in a list sorted by frame
+//
+static vector<Keyframe *>::const_iterator keyAfter(const vector<Keyframe *> &list, int frame) {
+	return std::upper_bound(list.begin(), list.end(), frame,
+		[](int f, const Keyframe *k) { return f < k->frame; });
+}
+
+
+KeyTrack &KeyTrack::operator=(const KeyTrack &t) {
+	if (this == &t) return *this;
+
+	clear();
+	for (size_t i = 0; i < t.keys.size(); i++)
+		insert(new Keyframe(*t.keys[i]));
+	return *this;
+}
+
+
+void KeyTrack::clear() {
+	for (size_t i = 0; i < keys.size(); i++)
+		delete keys[i];
+	keys.clear();
+	for (int c = 0; c < Keyframe::NUM_CHANNELS; c++)
+		channelKeys[c].clear();
+}
+
+
+Keyframe *KeyTrack::latest(int frame) const {
+	auto it = keyAfter(keys, frame);
+	return (it == keys.begin()) ? NULL : *(it - 1);
+}
+
+
+Keyframe *KeyTrack::find(int frame) const {
+	Keyframe *k = latest(frame);
+	return (k && k->frame == frame) ? k : NULL;
+}
+
+
+//  ***
+//  the key goes in front of the first key after its frame, in the track and in
+//  the lists of its channels
+//
+void KeyTrack::insert(Keyframe *key) {
+	erase(key->frame);
+
+	keys.insert(keyAfter(keys, key->frame), key);
+	for (int c = 0; c < Keyframe::NUM_CHANNELS; c++)
+		if (key->channels & (1 << c))
+			channelKeys[c].insert(keyAfter(channelKeys[c], key->frame), key);
+}
+
+
+bool KeyTrack::erase(int frame) {
+	Keyframe *key = find(frame);
+	if (!key) return false;
+
+	// frames are unique in every list, so the key is the one before the first key after frame
+	//
+	keys.erase(keyAfter(keys, frame) - 1);
+	for (int c = 0; c < Keyframe::NUM_CHANNELS; c++)
+		if (key->channels & (1 << c))
+			channelKeys[c].erase(keyAfter(channelKeys[c], frame) - 1);
+
+	delete key;
+	return true;
+}
+
+
+void KeyTrack::bracket(int c, int frame, const Keyframe *&start, const Keyframe *&end) const {
+	const vector<Keyframe *> &list = channelKeys[c];
+	auto it = keyAfter(list, frame);
+	start = (it == list.begin()) ? NULL : *(it - 1);
+	end = (it == list.end()) ? NULL : *it;
+}
+
+
+// // // OCCLUSION FUNCTIONS // // //
+
+
+//  ***
+//  shadow rays only need to know if something is in the way, so these skip the
+//  hit point and normal. Rays are moved to object space without renormalizing
+//  the direction, which keeps t (and tMax) in world units.
+//
+bool SceneObject::occluded(const Ray &ray, float tMax, glm::vec3 &rendCamPos) {
+	glm::vec3 point, normal;
+	if (!intersect(ray, point, normal, rendCamPos)) return false;
+
+	float t = glm::dot(point - ray.p, ray.d);
+	return (t > 0 && t < tMax);
+}
+
+
+bool Sphere::occluded(const Ray &ray, float tMax, glm::vec3 &rendCamPos) {
+	glm::vec3 p = worldInverse * glm::vec4(ray.p, 1.0);
+	glm::vec3 d = worldInverse * glm::vec4(ray.d, 0.0);
+
+	float a = glm::dot(d, d);
+	float b = glm::dot(p, d);
+	float c = glm::dot(p, p) - radius * radius;
+	float disc = b * b - a * c;
+	if (disc < 0) return false;
+
+	float sq = sqrt(disc);
+	float t = (-b - sq) / a;
+	if (t <= 0) t = (-b + sq) / a;
+	return (t > 0 && t < tMax);
+}
+
+
+bool Cube::occluded(const Ray &ray, float tMax, glm::vec3 &rendCamPos) {
+	Ray boxRay = Ray(worldInverse * glm::vec4(ray.p, 1.0), worldInverse * glm::vec4(ray.d, 0.0));
+	AABB box = AABB(glm::vec3(-width / 2, -height / 2, -depth / 2), glm::vec3(width / 2, height / 2, depth / 2));
+
+	// a ray starting inside the cube enters it behind the origin and is not blocked, like intersect()
+	//
+	Hit hit;
+	return (box.intersect(boxRay, hit, 0, tMax) && hit.t > 0);
+}
+
+
+bool Mesh::occluded(const Ray &ray, float tMax, glm::vec3 &rendCamPos) {
+	glm::vec3 p = worldInverse * glm::vec4(ray.p, 1.0);
+	glm::vec3 d = worldInverse * glm::vec4(ray.d, 0.0);
+
+	return geometry->bvh.occluded(p, d, tMax);
+}
+
+
+bool Plane::occluded(const Ray &ray, float tMax, glm::vec3 &rendCamPos) {
+	float den = glm::dot(ray.d, normal);
+	if (fabs(den) <= std::numeric_limits<float>::epsilon()) return false;
+
+	float t = glm::dot(position - ray.p, normal) / den;
+	if (t <= 0 || t >= tMax) return false;
+
+	glm::vec3 pt = ray.p + t * ray.d;
+	return (pt.x > position.x - width / 2 && pt.x < position.x + width / 2 &&
+			pt.z > position.z - height / 2 && pt.z < position.z + height / 2);
+}
+
+
+// // // LIGHT CULLING FUNCTIONS // // //
+
+
+//  ***
+//  the spotlight test is the one the shader always used:
+//  dot(direction, p -> light) < cos(angle + 3.15), i.e. p is within about angle of the axis
+//
+bool Light::mayLight(const glm::vec3 &p, float cutoff) const {
+	float R = influenceRadius(cutoff);
+	glm::vec3 v = p - worldPosition();
+	if (glm::dot(v, v) > R * R) return false;
+
+	if (type == 1) {
+		glm::vec3 dNm = glm::normalize(getDirection());
+		glm::vec3 pNm = glm::normalize(worldPosition() - p);
+		return (glm::dot(dNm, pNm) < glm::cos(angle + 3.15));
+	}
+	return true;
+}
+
+
+//  ***
+//  the box is replaced by its bounding sphere for the cone test: the sphere is
+//  inside the cone if its axis angle minus the angle it subtends is within the spread
+//
+bool Light::mayLight(const AABB &box, float cutoff) const {
+	float R = influenceRadius(cutoff);
+	if (box.distance2(worldPosition()) > R * R) return false;
+
+	if (type == 1) {
+		float spread = angle + 3.15 - glm::pi<float>();
+		if (spread >= glm::pi<float>()) return true;
+
+		glm::vec3 v = box.center() - worldPosition();
+		float dist = glm::length(v);
+		float rad = glm::length(box.max - box.min) / 2;
+		if (dist <= rad) return true;
+
+		float axis = acos(glm::clamp(glm::dot(glm::normalize(getDirection()), v / dist), -1.0f, 1.0f));
+		return (axis - asin(rad / dist) <= spread + 0.001);
+	}
+	return true;
+}
+
+
 // Generate a rotation matrix that rotates v1 to v2
 // v1, v2 must be normalized
 //
@@ -16,28 +16,11 @@
 #pragma once
 
 #include "ofMain.h"
-#include "box.h"
+#include "ray.h"
+#include "bvh.h"
+#include "pool.h"
 
 
-//  General Purpose Ray class
-//  
-class Ray {
-public:
-	glm::vec3 p, d;
-
-	Ray(glm::vec3 p, glm::vec3 d) { 
-		this->p = p; this->d = d; 
-	}
-
-	void draw(float t) { 
-		ofDrawLine(p, p + t * d); 
-	}
-
-	glm::vec3 evalPoint(float t) {
-		return (p + t * d);
-	}
-};
-
 //  ***
 //  Keyframe class for Animation features
 //  Holds an object's transformation channels for each keyframe
@@ -51,13 +34,40 @@ public:
 	glm::vec3 scale = glm::vec3(1, 1, 1);      // scale
 
 	glm::vec3 pivot = glm::vec3(0, 0, 0);
-	Keyframe(int fr, int fn, glm::vec3 p, glm::vec3 r, glm::vec3 s, glm::vec3 pv) {
+
+	//  ***
+	//  channels the key sets, bit 1 << channel; the others are left to the keys around it
+	//  keys made in the editor set the transform (the pivot is not animated there)
+	//
+	enum Channel { POSITION, ROTATION, SCALE, PIVOT, NUM_CHANNELS };
+	const static int TRANSFORM = (1 << POSITION) | (1 << ROTATION) | (1 << SCALE);
+	int channels = TRANSFORM;
+
+	Keyframe(int fr, int fn, glm::vec3 p, glm::vec3 r, glm::vec3 s, glm::vec3 pv, int ch = TRANSFORM) {
 		frame = fr;
 		function = fn;
 		position = p;
 		rotation = r;
 		scale = s;
 		pivot = pv;
+		channels = ch;
+	}
+
+	// *** keys are allocated from a BlockPool
+	//
+	static void *operator new(size_t size);
+	static void operator delete(void *p, size_t size);
+	static BlockPool &pool();
+
+	// *** value of a channel
+	//
+	const glm::vec3 &channel(int c) const {
+		switch (c) {
+		case POSITION: return position;
+		case ROTATION: return rotation;
+		case SCALE: return scale;
+		default: return pivot;
+		}
 	}
 
 	int frame = 0, function = 0;
@@ -68,6 +78,91 @@ public:
 	3 = ease in -> ease out
 	4 = ease out -> ease in
 	*/
+
+	//  ***
+	//  ratio (time / duration) of the in-between frames after this keyframe, eased by function
+	//  all easing equations are quadratic & derived from http://gizma.com/easing/
+	//
+	float ease(float ratio) const {
+		switch (function) {
+		//case 0: break;			//linear
+		case 1:						//ease-in
+			ratio *= ratio;
+			break;
+		case 2:						//ease-out
+			ratio *= -(ratio - 2);
+			break;
+		case 3:						//ease-in then ease-out
+			ratio *= 2;
+			if (ratio < 1)
+				ratio *= (float) ratio / 2;
+			else {
+				ratio--;
+				ratio = (float) -(ratio * (ratio - 2) - 1) / 2;
+			}
+			break;
+		case 4:						//ease-out then ease-in
+			ratio *= 2;
+			if (ratio < 1)
+				ratio *= (float) -(ratio - 2) / 2;
+			else {
+				ratio--;
+				ratio = (float) (ratio * ratio + 1) / 2;
+			}
+			break;
+		}
+		return ratio;
+	}
+};
+
+
+//  ***
+//  Keyframes of one object, sorted by frame
+//  Only frames with a key are stored, so a static object holds a single key and the
+//  timeline has no fixed length. Each channel also has the list of the keys that set
+//  it, so the keys around a frame are found with a binary search per channel.
+//  The track owns its keys (copies are deep); a key's frame and channels must not
+//  change while it is in a track.
+//
+class KeyTrack {
+public:
+	// // // FUNCTIONS // // //
+
+	KeyTrack() {}
+	KeyTrack(const KeyTrack &t) { *this = t; }
+	KeyTrack &operator=(const KeyTrack &t);
+	~KeyTrack() { clear(); }
+
+	int size() const { return (int)keys.size(); }
+	bool empty() const { return keys.empty(); }
+	Keyframe *operator[](int i) const { return keys[i]; }
+
+	// key at frame, NULL if there is none
+	//
+	Keyframe *find(int frame) const;
+
+	// last key at or before frame, NULL if there is none
+	//
+	Keyframe *latest(int frame) const;
+
+	int lastFrame() const { return keys.empty() ? -1 : keys.back()->frame; }
+
+	// add key, replacing the one at its frame; the track takes ownership
+	//
+	void insert(Keyframe *key);
+	bool erase(int frame);
+	void clear();
+
+	// keys of channel c around frame: start is the last at or before it,
+	// end the first after it, NULL where there is none
+	//
+	void bracket(int c, int frame, const Keyframe *&start, const Keyframe *&end) const;
+
+private:
+	// // // VARIABLES // // //
+
+	vector<Keyframe *> keys;
+	vector<Keyframe *> channelKeys[Keyframe::NUM_CHANNELS];
 };
 
 
@@ -104,17 +199,57 @@ public:
 	//  ***
 	//  Keyframe animation parameters
 	// 
-	const static int totalFrames = 120;
-	Keyframe *frames[totalFrames] = {};
-	bool frmExist[totalFrames] = { false };
+	KeyTrack keys;
+
+	// *** slot in ofApp::scene (copied by clone(), render snapshots do not use it)
+	//
+	Handle handle;
+
+	//  ***
+	//  cached world transform and its inverse, valid after updateMatrix()
+	//  intersect() reads these directly so no matrix is built per ray
+	//
+	glm::mat4 worldMatrix = glm::mat4(1.0);
+	glm::mat4 worldInverse = glm::mat4(1.0);
 
 
 	// // // FUNCTIONS // // //
 
+	virtual ~SceneObject() {}		// *** so deleting an instance releases what it owns
+
+	// *** objects of every type are allocated from a BlockPool, the virtual
+	// destructor gives operator delete the size of the object's own type
+	//
+	static void *operator new(size_t size);
+	static void operator delete(void *p, size_t size);
+	static BlockPool &pool();
+
 	virtual void draw() = 0;    // pure virtual funcs - must be overloaded
 	virtual void drawEdges() = 0;
+
+	// *** copy of the object for a render snapshot, its parent and children still point into the scene
+	//
+	virtual SceneObject *clone() const = 0;
 	virtual bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, glm::vec3 &rendCamPos) { return false; }
 
+	//  ***
+	//  any hit query for shadow rays: true if the object is hit at 0 < t < tMax along ray.d
+	//  no point or normal is produced; by default this falls back to intersect()
+	//
+	virtual bool occluded(const Ray &ray, float tMax, glm::vec3 &rendCamPos);
+
+	//  ***
+	//  bounding boxes for the scene BVH
+	//  objects that cannot be bounded return false and are tested against every ray
+	//
+	virtual bool getLocalBounds(AABB &box) { return false; }
+
+	virtual AABB getBounds() {
+		AABB box;
+		if (getLocalBounds(box)) return box.transform(getMatrix());
+		return AABB(glm::vec3(-std::numeric_limits<float>::infinity()), glm::vec3(std::numeric_limits<float>::infinity()));
+	}
+
 	// commonly used transformations
 	//
 	glm::mat4 getRotateMatrix() {
@@ -145,16 +280,27 @@ public:
 	    return (trans * post * rotate * pre * scale);
 	}
 
+	//  ***
+	//  recompute the cached matrices if the channels, the parent or the parent's
+	//  transform changed since the last call (the parent chain is checked first)
+	//
+	void updateMatrix();
+
 	glm::mat4 getMatrix() {
+		updateMatrix();
+		return worldMatrix;
+	}
 
-		// if we have a parent (we are not the root),
-		// concatenate parent's transform (this is recursive)
-		// 
-		if (parent) {
-			glm::mat4 M = parent->getMatrix();
-			return (M * getLocalMatrix());
-		}
-		else return getLocalMatrix();  // priority order is SRT
+	glm::mat4 getInverseMatrix() {
+		updateMatrix();
+		return worldInverse;
+	}
+
+	// *** changes every time the world transform changes, see SceneBVH::update
+	//
+	unsigned long getStamp() {
+		updateMatrix();
+		return stamp;
 	}
 
 	// get current Position in World Space
@@ -163,22 +309,45 @@ public:
 		return (getMatrix() * glm::vec4(0.0, 0.0, 0.0, 1.0));
 	}
 
+	// *** world position from the cached matrix without updating it, read only so it
+	// can be called from the render threads (SceneBVH::update brings the matrices up to date)
+	//
+	glm::vec3 worldPosition() const {
+		return glm::vec3(worldMatrix[3]);
+	}
+
 	// set position (pos is in world space)
 	//
 	void setPosition(glm::vec3 pos) {
-		position = glm::inverse(getMatrix()) * glm::vec4(pos, 1.0);
+		position = getInverseMatrix() * glm::vec4(pos, 1.0);
 	}
 
 	// return a rotation  matrix that rotates one vector to another
 	//
 	glm::mat4 rotateToVector(glm::vec3 v1, glm::vec3 v2);
 
+	//  ***
+	//  set the channels to their keyframed values at frame, from the keys around it
+	//  (interpolated, or held at the last key when interpolate is false)
+	//  needs no playback state, so any frame can be evaluated
+	//
+	void evalFrame(int frame, bool interpolate = true);
+
 	//  Hierarchy 
 	//
 	void addChild(SceneObject *child) {
 		childList.push_back(child);
 		child->parent = this;
 	}
+
+private:
+	//  ***
+	//  channel values the cached matrices were built from
+	//  stamp changes every time the matrices are rebuilt, children compare it to parentStamp
+	//
+	glm::vec3 cachedPosition, cachedRotation, cachedScale, cachedPivot;
+	SceneObject *cachedParent = NULL;
+	unsigned long stamp = 0, parentStamp = 0;
 };
 
 
@@ -207,6 +376,12 @@ public:
 	}
 
 	bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, glm::vec3 &rendCamPos);
+	bool occluded(const Ray &ray, float tMax, glm::vec3 &rendCamPos);
+	bool getLocalBounds(AABB &box) {
+		box = AABB(glm::vec3(-width / 2, -height / 2, -depth / 2), glm::vec3(width / 2, height / 2, depth / 2));
+		return true;
+	}
+	SceneObject *clone() const { return new Cube(*this); }	// ***
 	void draw();
 	void drawEdges();
 };
@@ -235,32 +410,80 @@ public:
 	Sphere() {}
 
 	bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, glm::vec3 &rendCamPos);
+	bool occluded(const Ray &ray, float tMax, glm::vec3 &rendCamPos);
+	bool getLocalBounds(AABB &box) {
+		box = AABB(glm::vec3(-radius), glm::vec3(radius));
+		return true;
+	}
+	SceneObject *clone() const { return new Sphere(*this); }	// ***
 	void draw();
 	void drawEdges();
 };
 
 
+//  ***
+//  Triangle geometry shared by any number of Mesh instances
+//  Holds the ofMesh used for drawing and the object space (bottom level) BVH
+//  the triangles are traced through, see MeshBVH.
+//
+class MeshGeometry {
+public:
+	// // // VARIABLES // // //
+
+	ofMesh mesh;
+	MeshBVH bvh;
+	bool welded = false;		// mesh is indexed with no repeated positions (read by MeshLoader)
+
+	// // // FUNCTIONS // // //
+
+	MeshGeometry() {}
+	MeshGeometry(const ofMesh &m, MeshBVH::Layout layout = MeshBVH::FULL) {
+		mesh = m;
+		build(layout);
+	}
+
+	// (re)build the BVH of mesh in layout
+	//
+	void build(MeshBVH::Layout layout) {
+		if (welded) bvh.build(mesh.getVertices(), mesh.getIndices(), layout);
+		else bvh.build(mesh, layout);
+	}
+};
+
+
 //  ***
 //  Triangle Mesh class
-//  Uses ofMesh to hold mesh properties
+//  A mesh is an instance of a MeshGeometry: it only carries its own transform and
+//  material, so repeated meshes share one copy of the triangles and their BVH.
+//  The scene BVH over the instances' world bounds is the top level of the hierarchy.
 //
 class Mesh : public SceneObject {
 public:
 	// // // VARIABLES // // //
 
-	ofMesh mesh;
-	vector<ofMeshFace> faces;
+	shared_ptr<MeshGeometry> geometry;
 
 	// // // FUNCTIONS // // //
 
+	Mesh(shared_ptr<MeshGeometry> g, glm::vec3 p = glm::vec3(0,0,0), ofColor diffuse = ofColor::yellow) {
+		geometry = g;
+		position = p;
+		diffuseColor = diffuse;
+	}
+
 	Mesh(ofMesh m, glm::vec3 p = glm::vec3(0,0,0), ofColor diffuse = ofColor::yellow) {
-		mesh = m;
+		geometry = make_shared<MeshGeometry>(m);
 		position = p;
-		faces = mesh.getUniqueFaces();
 		diffuseColor = diffuse;
 	}
 
 	bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, glm::vec3 &rendCamPos);
+	bool occluded(const Ray &ray, float tMax, glm::vec3 &rendCamPos);
+	bool getLocalBounds(AABB &box) {
+		box = geometry->bvh.bounds();
+		return !box.isEmpty();
+	}
+	SceneObject *clone() const { return new Mesh(*this); }	// ***
 	void draw();
 	void drawEdges();
 };
@@ -289,13 +512,25 @@ public:
 		plane.setPosition(position);
 		plane.setWidth(width);
 		plane.setHeight(height);
-		plane.setResolution(4, 4);		
+		plane.setResolution(5, 5);		
 		isLocked = true;
 	}
 
 	bool intersect(const Ray &ray, glm::vec3 & point, glm::vec3 & normalAtIntersect, glm::vec3 &rendCamPos);
+	bool occluded(const Ray &ray, float tMax, glm::vec3 &rendCamPos);
+	SceneObject *clone() const { return new Plane(*this); }	// ***
 	void draw();
 	void drawEdges();
+
+	//  ***
+	//  the plane is intersected in world space at its position (see Plane::intersect),
+	//  so its bounds ignore the transform; padded so the flat box has some thickness
+	//
+	AABB getBounds() {
+		float e = 0.001;
+		return AABB(glm::vec3(position.x - width / 2, position.y - e, position.z - height / 2),
+					glm::vec3(position.x + width / 2, position.y + e, position.z + height / 2));
+	}
 };
 
 
@@ -354,6 +589,7 @@ public:
 		return (glm::vec3(((u * w) + min.x)*rt, ((v * h) + min.y)*rt, position.z));
 	}
 
+	SceneObject *clone() const { return new ViewPlane(*this); }	// ***
 	void draw() {
 		ofDrawRectangle(glm::vec3(min.x*rt, min.y*rt, position.z), width()*rt, height()*rt);
 	}
@@ -422,6 +658,7 @@ public:
 		return(Ray(position, glm::normalize(pointOnPlane - position)));
 	}
 
+	SceneObject *clone() const { return new RenderCam(*this); }	// ***
 	void draw() {
 		ofDrawBox(position, 1.0);
 	};
@@ -471,6 +708,17 @@ public:
 		return (glm::vec3((p.x - w / 2 + (u * w)), p.y, (p.z - h / 2 + (v * h))));
 	}
 
+	//  ***
+	//  toWorld from the cached matrix, read only for the render threads
+	//
+	glm::vec3 samplePoint(float u, float v) const {
+		float w = max.x - min.x;
+		float h = max.y - min.y;
+		glm::vec3 p = worldPosition();
+		return (glm::vec3((p.x - w / 2 + (u * w)), p.y, (p.z - h / 2 + (v * h))));
+	}
+
+	SceneObject *clone() const { return new QuadArea(*this); }	// ***
 	void draw() {
 		plane.setPosition(position);
 		plane.setWidth(width());
@@ -491,12 +739,12 @@ public:
 	float intensity = 10.0;
 	float power = 2.0;	
 	float angle = 0.5;
-	glm::vec3 direction = glm::vec3(0, -1, 0);
 	QuadArea area;
 	int N = 20;
 	int type = 0;	//0 = point light
 					//1 = spot light
 					//2 = area light
+	Handle lightHandle;		// *** slot in ofApp::lights
 
 	// // // FUNCTIONS // // //
 
@@ -511,6 +759,26 @@ public:
 		return Sphere::intersect(ray, point, normal, rendCamPos); 
 	}
 
+	//  ***
+	//  light culling: false if the light cannot change the shading of p (or of any
+	//  point in box), because intensity / r^2 is below cutoff there or p is outside
+	//  a spotlight's cone. The box test is conservative, the point test matches the shading.
+	//
+	float influenceRadius(float cutoff) const {
+		return sqrt(intensity / cutoff);
+	}
+	bool mayLight(const glm::vec3 &p, float cutoff) const;
+	bool mayLight(const AABB &box, float cutoff) const;
+
+	//  ***
+	//  spotlight axis in world space, the light's -y axis
+	//  computed from the cached inverse instead of being stored by draw()
+	//
+	glm::vec3 getDirection() const {
+		return glm::vec3(glm::vec4(0, -1, 0, 1) * worldInverse);
+	}
+
+	SceneObject *clone() const { return new Light(*this); }	// ***
 	void draw() {
 		if (type == 0) //ambient point light - hard shadows
 			Sphere::draw();
@@ -520,9 +788,8 @@ public:
 
 			ofSetColor(ofColor::orange);
 
-			glm::mat4 mInv = glm::inverse(getMatrix());			
-			direction = glm::vec4(0, -1, 0, 1) * mInv;
-			Ray r = Ray(getPosition(), direction);
+			glm::vec3 p = getPosition();	// updates the matrices getDirection reads
+			Ray r = Ray(p, getDirection());
 			r.draw(5);
 		}
 		else if (type == 2) { //area light - soft shadows
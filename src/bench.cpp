@@ -0,0 +1,228 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#include "bench.h"
+#include "ofApp.h"
+#include <random>
+
+
+//  ***
+//  renders the scene for every thread count (and pass order) and compares the images
+//  with the first, 0 if they are all identical, 1 if not and 2 for bad settings
+//
+int RenderBench::run(const vector<string> &args) {
+	if (!parse(args)) return 2;
+	buildScene();
+
+	ofApp app;		// holds the render settings only, it is never set up
+	configure(app);
+
+	std::cout << "bench " << width << "x" << height << ", " << triangles << " triangles, "
+			  << scene.size() - lights.size() << " objects, " << lights.size() << " lights (area light N=" << areaN << ")"
+			  << ", many-light " << (many ? ofToString(many) : "off") << ", aa " << antialias << ", adaptive " << adaptive
+			  << ", packets " << packets << ", layout " << (layout == MeshBVH::FULL ? "full" : layout == MeshBVH::COMPACT ? "compact" : "compact16")
+			  << endl;
+
+	ofPixels first;
+	bool identical = true;
+
+	for (size_t t = 0; t < threads.size(); t++) {
+		ThreadPool pool(threads[t]);
+
+		for (int coarseToFine = 0; coarseToFine <= (progressive ? 1 : 0); coarseToFine++) {
+			Result best;
+			for (int r = 0; r < repeat; r++) {
+				Result result = render(app, pool, coarseToFine);
+				if (r == 0 || result.total() < best.total()) best = result;
+			}
+
+			size_t bytes = best.pixels.getWidth() * best.pixels.getHeight() * 3;
+			if (!first.getWidth()) first = best.pixels;
+			bool same = !memcmp(first.getData(), best.pixels.getData(), bytes);
+			identical &= same;
+
+			const RenderScene::Stats &s = best.stats;
+			std::cout << pool.size() << " threads" << (coarseToFine ? ", coarse to fine" : "")
+					  << ": prepare " << ofToString(best.prepare, 3) << " s, render " << ofToString(best.render, 3)
+					  << " s, penumbra " << ofToString(best.penumbra, 3) << " s, aa " << ofToString(best.antialias, 3)
+					  << " s, total " << ofToString(best.total(), 3) << " s" << endl
+					  << "    " << s.shadow << " shadow rays (" << s.shadowBlocked << " blocked), " << s.penumbra
+					  << " penumbra shadings, " << s.subpixel << " subpixel rays, " << s.steals << " tiles stolen, image "
+					  << (same ? "identical" : "DIFFERENT") << endl;
+
+			if (save) ofSaveImage(best.pixels, "bench_" + ofToString(pool.size()) + (coarseToFine ? "_progressive" : "") + ".png");
+		}
+	}
+
+	for (size_t i = 0; i < scene.size(); i++)
+		delete scene[i];
+	return identical ? 0 : 1;
+}
+
+
+//  ***
+//  setting=value pairs, see the class comment; false (and a message) for anything else
+//
+bool RenderBench::parse(const vector<string> &args) {
+	for (size_t i = 0; i < args.size(); i++) {
+		size_t eq = args[i].find('=');
+		string key = args[i].substr(0, eq), value = eq == string::npos ? "" : args[i].substr(eq + 1);
+		int n = ofToInt(value);
+
+		if (key == "threads") {
+			vector<string> counts = ofSplitString(value, ",");
+			for (size_t c = 0; c < counts.size(); c++)
+				if (ofToInt(counts[c]) > 0) threads.push_back(ofToInt(counts[c]));
+		}
+		else if (key == "size" && sscanf(value.c_str(), "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {}
+		else if (key == "triangles" && n > 0) triangles = n;
+		else if (key == "objects" && n >= 0) objects = n;
+		else if (key == "lights" && n >= 0) extraLights = n;
+		else if (key == "area" && n > 0) areaN = n;
+		else if (key == "many" && n >= 0) many = n;
+		else if (key == "aa") antialias = n != 0;
+		else if (key == "adaptive") adaptive = n != 0;
+		else if (key == "packets") packets = n != 0;
+		else if (key == "progressive") progressive = n != 0;
+		else if (key == "save") save = n != 0;
+		else if (key == "repeat" && n > 0) repeat = n;
+		else if (key == "layout" && value == "full") layout = MeshBVH::FULL;
+		else if (key == "layout" && value == "compact") layout = MeshBVH::COMPACT;
+		else if (key == "layout" && value == "compact16") layout = MeshBVH::COMPACT16;
+		else {
+			std::cout << "bench: cannot use " << args[i] << " (see bench.h for the settings)" << endl;
+			return false;
+		}
+	}
+
+	// one thread and all of them, unless the counts are given
+	//
+	if (threads.empty()) {
+		threads.push_back(1);
+		int all = std::max(1u, std::thread::hardware_concurrency());
+		if (all > 1) threads.push_back(all);
+	}
+	return true;
+}
+
+
+//  ***
+//  the random parts come from a fixed seed through mt19937, whose output (unlike
+//  the standard distributions) is the same on every platform
+//
+void RenderBench::buildScene() {
+	std::mt19937 random(2019);
+	auto uniform = [&](float lo, float hi) { return lo + (hi - lo) * float(random() / 4294967296.0); };
+
+	scene.push_back(new Plane(glm::vec3(0, -2, 0)));
+
+	// small triangles scattered through a box, seen partly in front of the spheres
+	//
+	ofMesh mesh;
+	for (int i = 0; i < triangles; i++) {
+		glm::vec3 c(uniform(-1, 1), uniform(-1, 1), uniform(-1, 1));
+		for (int k = 0; k < 3; k++)
+			mesh.addVertex(c + glm::vec3(uniform(0, 0.33f), uniform(0, 0.33f), uniform(0, 0.33f)));
+	}
+	scene.push_back(new Mesh(make_shared<MeshGeometry>(mesh, layout), glm::vec3(0, 0, 2)));
+
+	scene.push_back(new Cube(glm::vec3(-2, 0, 0), glm::vec3(20, 30, 0), glm::vec3(1, 1, 1)));
+	Sphere *sphere = new Sphere(glm::vec3(2, 0, 0), 1.0);
+	scene.push_back(sphere);
+	scene.push_back(new Sphere(glm::vec3(0, 1, -3), 1.5, ofColor(200, 100, 50)));
+	Cube *child = new Cube(glm::vec3(0, 2, 0), glm::vec3(0, 45, 0), glm::vec3(0.5, 0.5, 0.5));
+	sphere->addChild(child);
+	scene.push_back(child);
+
+	for (int i = 0; i < objects; i++) {
+		glm::vec3 p(uniform(-6, 6), uniform(-3, 3), uniform(-10, 2));
+		if (i % 2 == 0) scene.push_back(new Sphere(p, uniform(0.2f, 0.6f)));
+		else scene.push_back(new Cube(p, glm::vec3(uniform(0, 90), uniform(0, 90), 0), glm::vec3(uniform(0.2f, 0.5f))));
+	}
+
+	Light *area = new Light(glm::vec3(-3, 5, 1));
+	area->type = 2;
+	area->N = areaN;
+	area->intensity = 30;
+	area->diffuseColor = ofColor(200, 200, 255);
+	lights.push_back(area);
+
+	Light *point = new Light(glm::vec3(0, 6, 5));
+	point->intensity = 40;
+	point->diffuseColor = ofColor(255, 255, 255);
+	lights.push_back(point);
+
+	Light *spot = new Light(glm::vec3(3, 5, 3));
+	spot->type = 1;
+	spot->angle = 0.8;
+	spot->intensity = 30;
+	spot->diffuseColor = ofColor(255, 200, 200);
+	lights.push_back(spot);
+
+	// dim lights close to the floor, each one reaches only a few tiles
+	//
+	for (int i = 0; i < extraLights; i++) {
+		Light *l = new Light(glm::vec3(uniform(-10, 10), -0.5, uniform(-10, 10)));
+		l->type = i % 2;
+		l->angle = 0.6;
+		l->intensity = 0.02;
+		l->diffuseColor = ofColor(255, 230, 150);
+		lights.push_back(l);
+	}
+
+	for (size_t l = 0; l < lights.size(); l++)
+		scene.push_back(lights[l]);
+}
+
+
+//  ***
+//  the view plane keeps the extent of the app's 1200 x 800 one at any image size
+//
+void RenderBench::configure(ofApp &app) const {
+	app.imgW = width;
+	app.imgH = height;
+	app.renderCam.setSize(glm::vec2(-width / 2, -height / 2), glm::vec2(width / 2, height / 2));
+	app.renderCam.view.rt = 0.005f * 1200 / width;
+
+	app.bAntialias = antialias;
+	app.bAdaptiveShadows = adaptive;
+	app.bPackets = packets;
+	app.bManyLights = many > 0;
+	if (many) app.lightBudget = many;
+}
+
+
+//  ***
+//  one render like ofApp::renderLoop, timed pass by pass
+//
+RenderBench::Result RenderBench::render(const ofApp &app, ThreadPool &pool, bool coarseToFine) const {
+	Result result;
+	std::atomic<bool> cancel(false);
+
+	float start = ofGetElapsedTimef();
+	RenderScene rs(scene, lights, app);
+	rs.prepare();
+	result.prepare = ofGetElapsedTimef() - start;
+
+	start = ofGetElapsedTimef();
+	int firstStep = coarseToFine ? app.progressiveStep : 1;
+	for (int step = firstStep; step >= 1; step /= 2)
+		rs.renderPass(pool, step, step == firstStep, cancel);
+	result.render = ofGetElapsedTimef() - start;
+
+	start = ofGetElapsedTimef();
+	if (rs.bAdaptiveShadows) rs.penumbraPass(&pool, cancel);
+	result.penumbra = ofGetElapsedTimef() - start;
+
+	start = ofGetElapsedTimef();
+	if (rs.bAntialias) rs.antialiasPass(&pool, cancel);
+	result.antialias = ofGetElapsedTimef() - start;
+
+	result.stats = rs.stats;
+	rs.fillBlocks(1, result.pixels);
+	return result;
+}
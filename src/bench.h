@@ -0,0 +1,71 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#pragma once
+
+#include "ofMain.h"
+#include "renderscene.h"
+
+class ofApp;
+
+//  ***
+//  Headless benchmark of the renderer, no window:
+//      RayTraceAnimation --bench [setting=value ...]
+//  Builds a fixed test scene (a mesh of random triangles on a plane, spheres, cubes,
+//  an area, a point and a spot light) and renders it once for every thread count,
+//  printing the time of each pass and the ray counters. Every image is compared with
+//  the first, so one run shows whether renders are identical for any thread count (and
+//  with progressive=1 for the coarse to fine passes too); the exit code is 1 if not.
+//  The scene only depends on the settings, runs on different builds can be compared.
+//  Settings, defaults in brackets:
+//      threads=1,4,16      render thread counts [1 and one per hardware thread]
+//      size=600x400        image size [600x400]
+//      triangles=N         triangles of the random mesh [2000]
+//      objects=N           extra random spheres and cubes [0]
+//      lights=N            extra small point and spot lights [0]
+//      area=N              points on the area light [16]
+//      many=N              many-light sampling with N lights per point [off]
+//      aa, adaptive, packets = 0 or 1, the render switches [1]
+//      layout=full|compact|compact16   mesh BVH layout [full]
+//      progressive=0|1     also render every count coarse to fine [0]
+//      repeat=N            renders per run, the fastest is reported [1]
+//      save=0|1            write bench_<threads>.png to the data folder [0]
+//
+class RenderBench {
+public:
+	int run(const vector<string> &args);
+
+private:
+	// // // VARIABLES // // //
+
+	vector<int> threads;
+	int width = 600, height = 400;
+	int triangles = 2000, objects = 0, extraLights = 0, areaN = 16, many = 0;
+	bool antialias = true, adaptive = true, packets = true, progressive = false, save = false;
+	MeshBVH::Layout layout = MeshBVH::FULL;
+	int repeat = 1;
+
+	vector<SceneObject *> scene;	// scene[0] is the plane, like ofApp::scene
+	vector<Light *> lights;
+
+	// what one render took
+	//
+	struct Result {
+		float prepare = 0, render = 0, penumbra = 0, antialias = 0;
+		RenderScene::Stats stats;
+		ofPixels pixels;
+
+		float total() const { return prepare + render + penumbra + antialias; }
+	};
+
+	// // // FUNCTIONS // // //
+
+	bool parse(const vector<string> &args);
+	void buildScene();
+	void configure(ofApp &app) const;
+	Result render(const ofApp &app, ThreadPool &pool, bool coarseToFine) const;
+};
@@ -0,0 +1,828 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#include <future>
+#include "bvh.h"
+#include "Primitives.h"
+
+
+// // // AABB FUNCTIONS // // //
+
+
+//  ***
+//  transform all 8 corners and bound the result
+//
+AABB AABB::transform(const glm::mat4 &m) const {
+	AABB b;
+	if (isEmpty()) return b;
+
+	for (int i = 0; i < 8; i++) {
+		glm::vec3 c = glm::vec3((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+		b.expand(glm::vec3(m * glm::vec4(c, 1.0)));
+	}
+	return b;
+}
+
+
+//  ***
+//  slab test against the box, the ray-box test of Williams et al. (see ray.h)
+//  NaNs from 0 * inf (ray origin on a slab with a parallel direction) fail the comparisons and are ignored
+//
+bool AABB::slabs(const glm::vec3 &p, const glm::vec3 &invD, float t0, float t1, float &tEntry, int &axis) const {
+	axis = -1;
+
+	for (int i = 0; i < 3; i++) {
+		float tNear = (min[i] - p[i]) * invD[i];
+		float tFar = (max[i] - p[i]) * invD[i];
+		if (tNear > tFar) std::swap(tNear, tFar);
+		if (tNear > t0) {
+			t0 = tNear;
+			axis = i;
+		}
+		if (tFar < t1) t1 = tFar;
+		if (t0 > t1) return false;
+	}
+
+	tEntry = t0;
+	return true;
+}
+
+
+bool AABB::intersect(const glm::vec3 &p, const glm::vec3 &invD, float tMax, float &tEntry) const {
+	int axis;
+	return slabs(p, invD, 0, tMax, tEntry, axis);
+}
+
+
+//  ***
+//  entering through the min face (positive direction) gives -1 on that axis
+//  a ray that is already inside at t0 gets the normal of the face it entered through before t0
+//
+bool AABB::intersect(const Ray &r, Hit &hit, float t0, float t1) const {
+	int axis;
+	if (!slabs(r.p, r.invD, t0, t1, hit.t, axis)) return false;
+
+	if (axis < 0) {
+		glm::vec3 entry(r.sign[0] ? max.x : min.x, r.sign[1] ? max.y : min.y, r.sign[2] ? max.z : min.z);
+		glm::vec3 back = (entry - r.p) * r.invD;
+		axis = (back.x > back.y && back.x > back.z) ? 0 : (back.y > back.z ? 1 : 2);
+	}
+	hit.point = r.evalPoint(hit.t);
+	hit.normal = glm::vec3(0);
+	hit.normal[axis] = r.sign[axis] ? 1.0f : -1.0f;
+	return true;
+}
+
+
+// // // SCENE BVH FUNCTIONS // // //
+
+
+void SceneBVH::clear() {
+	nodes.clear();
+	items.clear();
+	unbounded.clear();
+	objects.clear();
+	bounds.clear();
+	isLight.clear();
+	leafOf.clear();
+	stamps.clear();
+}
+
+
+//  ***
+//  build the hierarchy from the current world space bounds of every object
+//  update() decides when this is needed again
+//
+void SceneBVH::build(const vector<SceneObject *> &objs) {
+	clear();
+	objects = objs;
+	bounds.resize(objects.size());
+	isLight.resize(objects.size());
+	leafOf.assign(objects.size(), -1);
+	stamps.resize(objects.size());
+
+	// intersectors read the cached matrices, so bring them up to date once here
+	//
+	for (size_t i = 0; i < objects.size(); i++) {
+		stamps[i] = objects[i]->getStamp();
+		bounds[i] = objects[i]->getBounds();
+		isLight[i] = (typeid(*objects[i]) == typeid(Light));
+
+		if (bounds[i].isFinite()) items.push_back(i);
+		else unbounded.push_back(i);
+	}
+
+	if (items.size()) {
+		nodes.reserve(2 * items.size());
+		buildNode(0, items.size(), -1);
+	}
+
+	buildCost = cost();
+	numBuilds++;
+}
+
+
+//  ***
+//  refit the tree for moved objects, or rebuild it if that is not possible / worthwhile
+//
+void SceneBVH::update(const vector<SceneObject *> &objs) {
+	if (objs != objects) {
+		build(objs);
+		return;
+	}
+
+	// new bounds for the objects whose transform changed, and mark the nodes above them
+	//
+	vector<bool> dirty(nodes.size(), false);
+	bool moved = false;
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		unsigned long s = objects[i]->getStamp();
+		if (s == stamps[i]) continue;
+
+		stamps[i] = s;
+		bounds[i] = objects[i]->getBounds();
+
+		// an object that gained or lost finite bounds changes the topology
+		// (so does a new object that was allocated where a deleted one used to be)
+		//
+		if (bounds[i].isFinite() != (leafOf[i] >= 0) || isLight[i] != (typeid(*objects[i]) == typeid(Light))) {
+			build(objs);
+			return;
+		}
+
+		for (int n = leafOf[i]; n >= 0 && !dirty[n]; n = nodes[n].parent)
+			dirty[n] = true;
+		moved |= (leafOf[i] >= 0);
+	}
+
+	if (!moved) return;
+
+	// children are stored after their parents, so a reverse sweep is bottom up
+	//
+	for (int n = nodes.size() - 1; n >= 0; n--) {
+		if (!dirty[n]) continue;
+
+		Node &node = nodes[n];
+		node.box = AABB();
+		if (node.count) {
+			for (int i = node.start; i < node.start + node.count; i++)
+				node.box.expand(bounds[items[i]]);
+		}
+		else {
+			node.box.expand(nodes[n + 1].box);
+			node.box.expand(nodes[node.right].box);
+		}
+	}
+	numRefits++;
+
+	if (cost() > rebuildRatio * buildCost)
+		build(objs);
+}
+
+
+//  ***
+//  surface area heuristic: a node is visited in proportion to its area, an inner node
+//  costs one box test per child and a leaf one test per object. Dividing by the object
+//  areas (not the root area) makes a refit tree comparable to the one that was built
+//
+float SceneBVH::cost() const {
+	if (nodes.empty()) return 0;
+
+	float objArea = 0;
+	for (size_t i = 0; i < items.size(); i++) objArea += bounds[items[i]].surfaceArea();
+	if (objArea <= 0) return 0;
+
+	float c = 0;
+	for (size_t n = 0; n < nodes.size(); n++)
+		c += nodes[n].box.surfaceArea() * (nodes[n].count ? nodes[n].count : 2);
+	return c / objArea;
+}
+
+
+//  ***
+//  recursively split items[start, end) at the median centroid of the longest axis
+//  returns the index of the created node
+//
+int SceneBVH::buildNode(int start, int end, int parent) {
+	int n = nodes.size();
+	nodes.push_back(Node());
+	nodes[n].parent = parent;
+
+	AABB box, centroids;
+	for (int i = start; i < end; i++) {
+		box.expand(bounds[items[i]]);
+		centroids.expand(bounds[items[i]].center());
+	}
+	nodes[n].box = box;
+
+	if (end - start <= leafSize) {
+		nodes[n].start = start;
+		nodes[n].count = end - start;
+		for (int i = start; i < end; i++)
+			leafOf[items[i]] = n;
+		return n;
+	}
+
+	int axis = centroids.longestAxis();
+	int mid = (start + end) / 2;
+	std::nth_element(items.begin() + start, items.begin() + mid, items.begin() + end,
+		[&](int a, int b) { return bounds[a].center()[axis] < bounds[b].center()[axis]; });
+
+	buildNode(start, mid, n);
+	int right = buildNode(mid, end, n);
+	nodes[n].right = right;
+	return n;
+}
+
+
+//  ***
+//  intersect a single object, t is the distance along the ray to the hit point
+//  hits behind the ray origin are rejected
+//
+bool SceneBVH::testObject(int i, const Ray &ray, glm::vec3 &rendCamPos, float &t, glm::vec3 &point, glm::vec3 &normal) {
+	if (!objects[i]->intersect(ray, point, normal, rendCamPos))
+		return false;
+
+	t = glm::dot(point - ray.p, ray.d);
+	return (t > 0);
+}
+
+
+//  ***
+//  closest hit, objects without bounds first, then the tree
+//
+bool SceneBVH::intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, int &obj,
+						 glm::vec3 &rendCamPos, bool includeLights, int hint) {
+	float near_t = std::numeric_limits<float>::infinity(), t;
+	glm::vec3 pt, nm;
+	bool hit = false;
+
+	// the hinted object is tested twice when it is hit again, but its t cuts off
+	// every node behind it, which is most of the tree for coherent rays
+	//
+	if (isCacheable(hint) && testObject(hint, ray, rendCamPos, t, pt, nm)) {
+		near_t = t;
+		point = pt;
+		normal = nm;
+		obj = hint;
+		hit = true;
+	}
+
+	for (size_t i = 0; i < unbounded.size(); i++) {
+		int k = unbounded[i];
+		if (isLight[k] && !includeLights) continue;
+		if (testObject(k, ray, rendCamPos, t, pt, nm) && t < near_t) {
+			near_t = t;
+			point = pt;
+			normal = nm;
+			obj = k;
+			hit = true;
+		}
+	}
+
+	if (nodes.empty()) return hit;
+
+	return traverse(0, ray, near_t, point, normal, obj, rendCamPos, includeLights) || hit;
+}
+
+
+//  ***
+//  closest hit below root, only hits nearer than near_t are reported
+//  children are visited near to far, and boxes further than the closest hit so far are skipped
+//
+bool SceneBVH::traverse(int root, const Ray &ray, float &near_t, glm::vec3 &point, glm::vec3 &normal, int &obj,
+						glm::vec3 &rendCamPos, bool includeLights) {
+	glm::vec3 pt, nm;
+	int stack[64], top = 0;
+	float t, tEntry, tLeft, tRight;
+	bool hit = false;
+
+	if (!nodes[root].box.intersect(ray.p, ray.invD, near_t, tEntry)) return false;
+	stack[top++] = root;
+
+	while (top) {
+		const Node &node = nodes[stack[--top]];
+
+		if (node.count) {
+			for (int i = node.start; i < node.start + node.count; i++) {
+				int k = items[i];
+				if (isLight[k] && !includeLights) continue;
+				if (testObject(k, ray, rendCamPos, t, pt, nm) && t < near_t) {
+					near_t = t;
+					point = pt;
+					normal = nm;
+					obj = k;
+					hit = true;
+				}
+			}
+			continue;
+		}
+
+		int left = &node - &nodes[0] + 1, right = node.right;
+		bool hitL = nodes[left].box.intersect(ray.p, ray.invD, near_t, tLeft);
+		bool hitR = nodes[right].box.intersect(ray.p, ray.invD, near_t, tRight);
+
+		// push the far child first so the near one is popped next
+		//
+		if (hitL && hitR) {
+			if (tLeft < tRight) { stack[top++] = right; stack[top++] = left; }
+			else { stack[top++] = left; stack[top++] = right; }
+		}
+		else if (hitL) stack[top++] = left;
+		else if (hitR) stack[top++] = right;
+	}
+
+	return hit;
+}
+
+
+//  ***
+//  shadow ray traversal, returns on the first blocker found before tMax
+//
+bool SceneBVH::occluded(const Ray &ray, float tMax, int ignore, glm::vec3 &rendCamPos, int *occluder) {
+	for (size_t i = 0; i < unbounded.size(); i++) {
+		int k = unbounded[i];
+		if (k == ignore || isLight[k]) continue;
+		if (objects[k]->occluded(ray, tMax, rendCamPos)) {
+			if (occluder) *occluder = k;
+			return true;
+		}
+	}
+
+	if (nodes.empty()) return false;
+
+	int stack[64], top = 0;
+	float tEntry;
+	stack[top++] = 0;
+
+	while (top) {
+		const Node &node = nodes[stack[--top]];
+		if (!node.box.intersect(ray.p, ray.invD, tMax, tEntry)) continue;
+
+		if (node.count) {
+			for (int i = node.start; i < node.start + node.count; i++) {
+				int k = items[i];
+				if (k == ignore || isLight[k]) continue;
+				if (objects[k]->occluded(ray, tMax, rendCamPos)) {
+					if (occluder) *occluder = k;
+					return true;
+				}
+			}
+		}
+		else {
+			stack[top++] = node.right;
+			stack[top++] = &node - &nodes[0] + 1;
+		}
+	}
+
+	return false;
+}
+
+
+// // // MESH BVH FUNCTIONS // // //
+
+
+//  ***
+//  weld the mesh into an indexed vertex buffer
+//  vertices at exactly the same position (split by normals or texture seams) become
+//  one vertex; the position sort keeps this O(n log n) without a hash table
+//
+static void weld(const ofMesh &mesh, vector<glm::vec3> &verts, vector<uint32_t> &tri) {
+	const vector<glm::vec3> &v = mesh.getVertices();
+	const vector<ofIndexType> &idx = mesh.getIndices();
+
+	vector<uint32_t> order(v.size()), remap(v.size());
+	for (size_t i = 0; i < v.size(); i++) order[i] = i;
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		if (v[a].x != v[b].x) return v[a].x < v[b].x;
+		if (v[a].y != v[b].y) return v[a].y < v[b].y;
+		return v[a].z < v[b].z;
+	});
+
+	verts.clear();
+	for (size_t i = 0; i < order.size(); i++) {
+		if (!i || v[order[i]] != v[order[i - 1]]) verts.push_back(v[order[i]]);
+		remap[order[i]] = verts.size() - 1;
+	}
+
+	// triangles, unindexed meshes use every 3 consecutive vertices
+	//
+	size_t n = idx.size() ? idx.size() : v.size();
+	tri.resize(n - n % 3);
+	for (size_t i = 0; i < tri.size(); i++)
+		tri[i] = remap[idx.size() ? idx[i] : i];
+}
+
+
+//  ***
+//  build the triangle hierarchy for a mesh, welded first
+//
+void MeshBVH::build(const ofMesh &mesh, Layout l) {
+	vector<glm::vec3> verts;
+	vector<uint32_t> tri;
+	weld(mesh, verts, tri);
+	build(verts, tri, l);
+}
+
+
+//  ***
+//  build the triangle hierarchy for a welded triangle list
+//  bounds and centroids are computed once, then the tree is split recursively
+//  and finally stored in the requested layout
+//  the arrays are only read, COMPACT16 quantizes a copy of the positions
+//
+void MeshBVH::build(const vector<glm::vec3> &welded, const vector<uint32_t> &tri, Layout l) {
+	layout = l;
+	rootBox = AABB();
+	nodes.clear();
+	blocks.clear();
+	wnodes.clear();
+	tris.clear();
+	vertices.clear();
+	qvertices.clear();
+
+	buildBytes = 0;
+
+	numVertices = welded.size();
+	numTriangles = tri.size() / 3;
+	if (!numTriangles) return;
+
+	// the tree is built around the positions the layout will actually store
+	//
+	vector<glm::vec3> quantized;
+	if (layout == COMPACT16) {
+		quantized = welded;
+		quantize(quantized);
+	}
+	const vector<glm::vec3> &verts = layout == COMPACT16 ? quantized : welded;
+
+	vector<AABB> boxes(numTriangles);
+	vector<glm::vec3> centers(numTriangles);
+	indices.resize(numTriangles);
+
+	for (int i = 0; i < numTriangles; i++) {
+		for (int j = 0; j < 3; j++)
+			boxes[i].expand(verts[tri[3 * i + j]]);
+		centers[i] = boxes[i].center();
+		indices[i] = i;
+	}
+
+	std::unique_ptr<BuildNode> root = buildNode(boxes, centers, 0, numTriangles, 0);
+	rootBox = root->box;
+
+	if (layout == FULL) {
+		nodes.reserve(2 * numTriangles / maxLeafSize + 1);
+		blocks.reserve(numTriangles / SIMD_WIDTH + 1);
+		flatten(root.get(), verts, tri);
+	}
+	else {
+		tris.reserve(3 * numTriangles);
+		collapse(root.get(), tri);
+		if (layout == COMPACT) vertices = verts;
+	}
+
+	// everything above is still held here, the result included
+	//
+	buildBytes = boxes.capacity() * sizeof(AABB) + centers.capacity() * sizeof(glm::vec3) +
+				 indices.capacity() * sizeof(int) + quantized.capacity() * sizeof(glm::vec3) +
+				 countNodes(root.get()) * sizeof(BuildNode) + memoryUsage();
+
+	indices.clear();
+	indices.shrink_to_fit();
+}
+
+
+//  ***
+//  nodes in a build tree
+//
+size_t MeshBVH::countNodes(const BuildNode *b) {
+	return b ? 1 + countNodes(b->left.get()) + countNodes(b->right.get()) : 0;
+}
+
+
+//  ***
+//  bytes of the nodes and triangle data, the ofMesh kept for drawing is not included
+//
+size_t MeshBVH::memoryUsage() const {
+	return nodes.capacity() * sizeof(Node) + blocks.capacity() * sizeof(TriangleBlock) +
+		   wnodes.capacity() * sizeof(WideNode) + tris.capacity() * sizeof(uint32_t) +
+		   vertices.capacity() * sizeof(glm::vec3) + qvertices.capacity() * sizeof(uint16_t);
+}
+
+
+//  ***
+//  binned SAH split of indices[start, end)
+//  the left half is built on a new thread while the subtree is large and
+//  there are cores left, the two halves never touch the same indices
+//  lopsided splits could make the tree deeper than the traversal stacks hold, so
+//  from medianDepth on the triangles are halved at the median instead, and at
+//  maxTreeDepth whatever is left becomes one leaf
+//
+std::unique_ptr<MeshBVH::BuildNode> MeshBVH::buildNode(vector<AABB> &boxes, vector<glm::vec3> &centers, int start, int end, int depth) {
+	std::unique_ptr<BuildNode> node(new BuildNode());
+	int count = end - start;
+
+	AABB centroids;
+	for (int i = start; i < end; i++) {
+		node->box.expand(boxes[indices[i]]);
+		centroids.expand(centers[indices[i]]);
+	}
+
+	node->start = start;
+	node->count = count;
+	if (count <= maxLeafSize || depth >= maxTreeDepth) return node;
+
+	// find the cheapest split plane over all axes
+	//
+	int bestAxis = -1, bestBin = -1;
+	float bestCost = std::numeric_limits<float>::infinity();
+
+	for (int axis = 0; axis < 3 && depth < medianDepth; axis++) {
+		float lo = centroids.min[axis], hi = centroids.max[axis];
+		if (hi <= lo) continue;
+
+		AABB bins[numBins];
+		int counts[numBins] = { 0 };
+		float k = numBins / (hi - lo);
+
+		for (int i = start; i < end; i++) {
+			int b = std::min(numBins - 1, (int)((centers[indices[i]][axis] - lo) * k));
+			bins[b].expand(boxes[indices[i]]);
+			counts[b]++;
+		}
+
+		// sweep from the right to get the area and count right of every plane
+		//
+		float rightArea[numBins];
+		int rightCount[numBins];
+		AABB acc;
+		int n = 0;
+		for (int b = numBins - 1; b > 0; b--) {
+			acc.expand(bins[b]);
+			n += counts[b];
+			rightArea[b] = acc.surfaceArea();
+			rightCount[b] = n;
+		}
+
+		acc = AABB();
+		n = 0;
+		for (int b = 0; b < numBins - 1; b++) {
+			acc.expand(bins[b]);
+			n += counts[b];
+			float cost = acc.surfaceArea() * n + rightArea[b + 1] * rightCount[b + 1];
+			if (n && rightCount[b + 1] && cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	// no split beats intersecting every triangle (relative to the parent area)
+	// keep a leaf unless it is too large
+	//
+	float leafCost = node->box.surfaceArea() * count;
+	int mid;
+
+	if (depth >= medianDepth) {
+		int axis = centroids.longestAxis();
+		mid = start + count / 2;
+		std::nth_element(&indices[start], &indices[mid], &indices[start] + count,
+			[&](int a, int b) { return centers[a][axis] < centers[b][axis]; });
+	}
+	else if (bestAxis >= 0 && (bestCost < leafCost || count > 4 * maxLeafSize)) {
+		float lo = centroids.min[bestAxis];
+		float k = numBins / (centroids.max[bestAxis] - lo);
+		int *m = std::partition(&indices[start], &indices[start] + count, [&](int f) {
+			return std::min(numBins - 1, (int)((centers[f][bestAxis] - lo) * k)) <= bestBin;
+		});
+		mid = m - &indices[0];
+	}
+	else if (count > 4 * maxLeafSize) {
+		// all centroids are equal, fall back to an even split
+		//
+		mid = start + count / 2;
+	}
+	else return node;
+
+	node->count = 0;
+
+	static const int maxDepth = (int)std::ceil(std::log2(std::max(1u, std::thread::hardware_concurrency())));
+	if (count > parallelThreshold && depth < maxDepth) {
+		std::future<std::unique_ptr<BuildNode>> left = std::async(std::launch::async,
+			&MeshBVH::buildNode, this, std::ref(boxes), std::ref(centers), start, mid, depth + 1);
+		node->right = buildNode(boxes, centers, mid, end, depth + 1);
+		node->left = left.get();
+	}
+	else {
+		node->left = buildNode(boxes, centers, start, mid, depth + 1);
+		node->right = buildNode(boxes, centers, mid, end, depth + 1);
+	}
+
+	return node;
+}
+
+
+//  ***
+//  copy the temporary tree into the flat depth first node array
+//  a leaf's start becomes the index of its first TriangleBlock
+//
+void MeshBVH::flatten(const BuildNode *b, const vector<glm::vec3> &verts, const vector<uint32_t> &tri) {
+	int n = nodes.size();
+	nodes.push_back(Node());
+	nodes[n].box = b->box;
+
+	if (!b->left) {
+		nodes[n].start = blocks.size();
+		nodes[n].count = b->count;
+		addBlocks(b->start, b->count, verts, tri);
+		return;
+	}
+
+	flatten(b->left.get(), verts, tri);
+	nodes[n].right = nodes.size();
+	flatten(b->right.get(), verts, tri);
+}
+
+
+//  ***
+//  pack triangles indices[start, start + count) into blocks, the normal and edges are computed here once
+//
+void MeshBVH::addBlocks(int start, int count, const vector<glm::vec3> &verts, const vector<uint32_t> &tri) {
+	for (int i = 0; i < count; i += SIMD_WIDTH) {
+		TriangleBlock blk;
+		for (int lane = 0; lane < SIMD_WIDTH; lane++) {
+			glm::vec3 v0(0), e1(0), e2(0), n(0);
+			int f = -1;
+
+			if (i + lane < count) {
+				f = indices[start + i + lane];
+				v0 = verts[tri[3 * f]];
+				e1 = verts[tri[3 * f + 1]] - v0;
+				e2 = verts[tri[3 * f + 2]] - v0;
+				n = glm::normalize(glm::cross(e1, e2));
+			}
+
+			for (int k = 0; k < 3; k++) {
+				blk.v0[k][lane] = v0[k];
+				blk.e1[k][lane] = e1[k];
+				blk.e2[k][lane] = e2[k];
+				blk.n[k][lane] = n[k];
+			}
+			blk.face[lane] = f;
+		}
+		blocks.push_back(blk);
+	}
+}
+
+
+//  ***
+//  Moller-Trumbore against all lanes of a block at once
+//  only front facing triangles (dot(d, n) < 0) count, as in the brute force version
+//  returns the lanes hit closer than near_t, their distances in t
+//
+static int intersectBlock(const TriangleBlock &blk, const vfloat p[3], const vfloat d[3], float near_t, vfloat &t) {
+	vfloat e1[3], e2[3], s[3], pv[3], qv[3];
+	for (int k = 0; k < 3; k++) {
+		e1[k] = vfloat::load(blk.e1[k]);
+		e2[k] = vfloat::load(blk.e2[k]);
+		s[k] = p[k] - vfloat::load(blk.v0[k]);
+	}
+
+	// pv = d x e2, det = e1 . pv
+	//
+	pv[0] = d[1] * e2[2] - d[2] * e2[1];
+	pv[1] = d[2] * e2[0] - d[0] * e2[2];
+	pv[2] = d[0] * e2[1] - d[1] * e2[0];
+	vfloat det = e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2];
+
+	// back facing and degenerate (padding) triangles have det <= 0
+	//
+	vfloat m = (det > std::numeric_limits<float>::epsilon()) &
+			   (d[0] * vfloat::load(blk.n[0]) + d[1] * vfloat::load(blk.n[1]) + d[2] * vfloat::load(blk.n[2]) < 0.0f);
+	if (!mask(m)) return 0;
+
+	vfloat inv = 1.0f / det;
+	vfloat u = (s[0] * pv[0] + s[1] * pv[1] + s[2] * pv[2]) * inv;
+
+	// qv = s x e1
+	//
+	qv[0] = s[1] * e1[2] - s[2] * e1[1];
+	qv[1] = s[2] * e1[0] - s[0] * e1[2];
+	qv[2] = s[0] * e1[1] - s[1] * e1[0];
+	vfloat v = (d[0] * qv[0] + d[1] * qv[1] + d[2] * qv[2]) * inv;
+	t = (e2[0] * qv[0] + e2[1] * qv[1] + e2[2] * qv[2]) * inv;
+
+	m = m & (u >= 0.0f) & (v >= 0.0f) & (u + v <= 1.0f) & (t >= 0.0f) & (t < near_t);
+	return mask(m);
+}
+
+
+//  ***
+//  closest hit traversal, leaves are tested one TriangleBlock at a time
+//  (the compact layouts are traced by traverseWide, see widebvh.cpp)
+//
+bool MeshBVH::intersect(const glm::vec3 &p, const glm::vec3 &d, float &t, int &face, glm::vec3 &normal) const {
+	if (layout != FULL)
+		return traverseWide(p, d, std::numeric_limits<float>::infinity(), false, t, face, normal);
+	if (nodes.empty()) return false;
+
+	float near_t = std::numeric_limits<float>::infinity(), tEntry, tLeft, tRight;
+	glm::vec3 invD = 1.0f / d;
+	vfloat vp[3] = { p.x, p.y, p.z }, vd[3] = { d.x, d.y, d.z };
+	SIMD_ALIGN float tLanes[SIMD_WIDTH];
+	const TriangleBlock *hitBlock = NULL;
+	int hitLane = 0;
+	int stack[64], top = 0;
+
+	if (!nodes[0].box.intersect(p, invD, near_t, tEntry)) return false;
+	stack[top++] = 0;
+
+	while (top) {
+		int n = stack[--top];
+		const Node &node = nodes[n];
+
+		if (node.count) {
+			int end = node.start + (node.count + SIMD_WIDTH - 1) / SIMD_WIDTH;
+			for (int b = node.start; b < end; b++) {
+				vfloat bt;
+				int bits = intersectBlock(blocks[b], vp, vd, near_t, bt);
+				if (!bits) continue;
+
+				bt.store(tLanes);
+				for (int lane = 0; lane < SIMD_WIDTH; lane++) {
+					if ((bits & (1 << lane)) && tLanes[lane] < near_t) {
+						near_t = tLanes[lane];
+						hitBlock = &blocks[b];
+						hitLane = lane;
+					}
+				}
+			}
+			continue;
+		}
+
+		int left = n + 1, right = node.right;
+		bool hitL = nodes[left].box.intersect(p, invD, near_t, tLeft);
+		bool hitR = nodes[right].box.intersect(p, invD, near_t, tRight);
+
+		if (hitL && hitR) {
+			if (tLeft < tRight) { stack[top++] = right; stack[top++] = left; }
+			else { stack[top++] = left; stack[top++] = right; }
+		}
+		else if (hitL) stack[top++] = left;
+		else if (hitR) stack[top++] = right;
+	}
+
+	if (!hitBlock) return false;
+
+	t = near_t;
+	face = hitBlock->face[hitLane];
+	normal = glm::vec3(hitBlock->n[0][hitLane], hitBlock->n[1][hitLane], hitBlock->n[2][hitLane]);
+	return true;
+}
+
+
+//  ***
+//  any hit traversal for shadow rays, returns at the first block with a hit before tMax
+//  (the compact layouts are traced by traverseWide, see widebvh.cpp)
+//
+bool MeshBVH::occluded(const glm::vec3 &p, const glm::vec3 &d, float tMax) const {
+	if (layout != FULL) {
+		float t;
+		int face;
+		glm::vec3 normal;
+		return traverseWide(p, d, tMax, true, t, face, normal);
+	}
+	if (nodes.empty()) return false;
+
+	glm::vec3 invD = 1.0f / d;
+	vfloat vp[3] = { p.x, p.y, p.z }, vd[3] = { d.x, d.y, d.z };
+	float tEntry;
+	int stack[64], top = 0;
+	stack[top++] = 0;
+
+	while (top) {
+		int n = stack[--top];
+		const Node &node = nodes[n];
+		if (!node.box.intersect(p, invD, tMax, tEntry)) continue;
+
+		if (node.count) {
+			int end = node.start + (node.count + SIMD_WIDTH - 1) / SIMD_WIDTH;
+			for (int b = node.start; b < end; b++) {
+				vfloat bt;
+				if (intersectBlock(blocks[b], vp, vd, tMax, bt)) return true;
+			}
+		}
+		else {
+			stack[top++] = node.right;
+			stack[top++] = n + 1;
+		}
+	}
+
+	return false;
+}
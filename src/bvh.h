@@ -0,0 +1,373 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#pragma once
+
+#include "ofMain.h"
+#include "simd.h"
+
+class Ray;
+struct Hit;
+class SceneObject;
+class Light;
+
+
+//  ***
+//  Axis aligned bounding box in glm types
+//  used as the bounding volume for the acceleration structures, and as the shape of
+//  a Cube in its object space
+//
+class AABB {
+public:
+	// // // VARIABLES // // //
+
+	glm::vec3 min = glm::vec3(std::numeric_limits<float>::infinity());	// empty box by default
+	glm::vec3 max = glm::vec3(-std::numeric_limits<float>::infinity());
+
+	// // // FUNCTIONS // // //
+
+	AABB() {}
+	AABB(glm::vec3 min, glm::vec3 max) {
+		this->min = min;
+		this->max = max;
+	}
+
+	void expand(const glm::vec3 &p) {
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	void expand(const AABB &b) {
+		min = glm::min(min, b.min);
+		max = glm::max(max, b.max);
+	}
+
+	glm::vec3 center() const {
+		return (min + max) * 0.5f;
+	}
+
+	bool isEmpty() const {
+		return (min.x > max.x || min.y > max.y || min.z > max.z);
+	}
+
+	// a box is finite if all its corners are real numbers
+	//
+	bool isFinite() const {
+		for (int i = 0; i < 3; i++)
+			if (!std::isfinite(min[i]) || !std::isfinite(max[i])) return false;
+		return true;
+	}
+
+	int longestAxis() const {
+		glm::vec3 e = max - min;
+		if (e.x > e.y && e.x > e.z) return 0;
+		return (e.y > e.z) ? 1 : 2;
+	}
+
+	// squared distance from p to the box, 0 inside
+	//
+	float distance2(const glm::vec3 &p) const {
+		glm::vec3 q = glm::clamp(p, min, max);
+		return glm::dot(p - q, p - q);
+	}
+
+	float surfaceArea() const {
+		if (isEmpty()) return 0;
+		glm::vec3 e = max - min;
+		return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+
+	// bounds of this box after transformation by m (all 8 corners are transformed)
+	//
+	AABB transform(const glm::mat4 &m) const;
+
+	// slab test, (tEntry, tExit) is clipped to [0, tMax]
+	// invD is 1 / ray direction, computed once per ray by the caller
+	//
+	bool intersect(const glm::vec3 &p, const glm::vec3 &invD, float tMax, float &tEntry) const;
+
+	// the same slab test for a ray hitting the box in (t0, t1), hit gets the entry
+	// point and the normal of the face the ray enters through
+	//
+	bool intersect(const Ray &r, Hit &hit, float t0, float t1) const;
+
+private:
+	// // // FUNCTIONS // // //
+
+	// (tEntry, tExit) clipped to [t0, t1], axis is the slab entered last (-1 if none is after t0)
+	//
+	bool slabs(const glm::vec3 &p, const glm::vec3 &invD, float t0, float t1, float &tEntry, int &axis) const;
+};
+
+
+//  ***
+//  Scene level bounding volume hierarchy
+//  Built over the world space bounds of every SceneObject so that a ray
+//  only calls SceneObject::intersect on the objects whose boxes it crosses.
+//  Objects without finite bounds are kept aside and always tested.
+//  The editor picks objects with it, renders trace the CompiledScene of their snapshot.
+//
+class SceneBVH {
+public:
+	// // // FUNCTIONS // // //
+
+	void build(const vector<SceneObject *> &objects);
+	void clear();
+
+	// keep the tree valid for the objects' current transforms
+	// objects that moved since the last call get new bounds and the tree is refit
+	// bottom up along their paths; it is rebuilt when the object list changed or
+	// when refitting made it much worse than a fresh build (see cost())
+	//
+	void update(const vector<SceneObject *> &objects);
+
+	// SAH cost of the tree (node areas weighted by the tests they cost), normalized by the
+	// total area of the object boxes so it stays comparable while objects move apart
+	//
+	float cost() const;
+
+	int numBuilds = 0, numRefits = 0;	// statistics
+
+	// closest hit along the ray, obj returns the index of the object in the list the tree was built from
+	// lights are only hit when includeLights is set (mouse picking)
+	// hint is an object likely to be hit (the last hit of a neighbouring ray), it is tested
+	// first so its distance prunes the traversal, -1 for none
+	//
+	bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, int &obj,
+				   glm::vec3 &rendCamPos, bool includeLights = false, int hint = -1);
+
+	// true if anything other than the ignored object (and lights) is hit before tMax
+	// used for shadow rays, stops at the first occluder found (SceneObject::occluded)
+	// which is returned in occluder when it is given
+	//
+	bool occluded(const Ray &ray, float tMax, int ignore, glm::vec3 &rendCamPos, int *occluder = NULL);
+
+	// an object can be given as a hint / occluder cache entry (bounded or not, not a light)
+	//
+	bool isCacheable(int i) const { return i >= 0 && i < (int)objects.size() && !isLight[i]; }
+
+	int size() { return (int)objects.size(); }
+
+private:
+	// // // VARIABLES // // //
+
+	// nodes are stored depth first, so the left child of node i is always i + 1
+	//
+	struct Node {
+		AABB box;
+		int parent = -1;	// -1 for the root
+		int right = -1;		// index of the right child (inner node)
+		int start = 0;		// first entry in items (leaf)
+		int count = 0;		// number of objects in the leaf, 0 for inner nodes
+	};
+
+	vector<Node> nodes;
+	vector<int> items;			// object indices ordered by leaf
+	vector<int> unbounded;		// objects that cannot be bounded, always tested
+	vector<SceneObject *> objects;
+	vector<AABB> bounds;
+	vector<bool> isLight;
+	vector<int> leafOf;			// leaf node holding each object, -1 if unbounded
+	vector<unsigned long> stamps;	// transform stamp of each object when its bounds were taken
+	float buildCost = 0;		// cost() right after the last build
+
+	const static int leafSize = 2;
+	constexpr static float rebuildRatio = 1.5f;	// rebuild once refits raise the cost by this much
+
+	// // // FUNCTIONS // // //
+
+	int buildNode(int start, int end, int parent);
+	bool traverse(int root, const Ray &ray, float &near_t, glm::vec3 &point, glm::vec3 &normal, int &obj,
+				  glm::vec3 &rendCamPos, bool includeLights);
+	bool testObject(int i, const Ray &ray, glm::vec3 &rendCamPos, float &t, glm::vec3 &point, glm::vec3 &normal);
+};
+
+
+//  ***
+//  Light hierarchy for many-light sampling
+//  Binary tree over the light positions, every node knows the total intensity
+//  below it and the largest influence radius. sample() walks down from the root
+//  choosing a child with probability proportional to its estimated contribution
+//  at the shading point (intensity / squared distance), so a light is picked with
+//  a known pdf that is never 0 for a light that can reach the point.
+//
+class LightBVH {
+public:
+	// // // FUNCTIONS // // //
+
+	// lights beyond their influence radius for cutoff (Light::influenceRadius) get no samples
+	//
+	void build(const vector<Light *> &lights, float cutoff);
+
+	// index into the lights the tree was built from, chosen with probability pdf
+	// u is uniform in [0, 1), -1 is returned when no light reaches p
+	//
+	int sample(const glm::vec3 &p, float u, float &pdf) const;
+
+	int size() const { return (int)lights.size(); }
+
+private:
+	// // // VARIABLES // // //
+
+	// depth first like SceneBVH, a leaf holds a single light
+	//
+	struct Node {
+		AABB box;
+		float intensity = 0;	// sum over the lights below
+		float radius = 0;		// largest influence radius below
+		int right = -1;
+		int light = -1;			// leaf only
+	};
+
+	vector<Node> nodes;
+	vector<Light *> lights;
+	vector<int> order;			// light indices ordered by leaf
+	vector<glm::vec3> positions;
+	float cutoff = 0;
+
+	// // // FUNCTIONS // // //
+
+	int buildNode(int start, int end);
+	float importance(const Node &node, const glm::vec3 &p) const;
+};
+
+
+//  ***
+//  SIMD_WIDTH triangles stored as a structure of arrays, ready for Moller-Trumbore
+//  v0 is the first vertex, e1 = v1 - v0, e2 = v2 - v0 and n the unit face normal
+//  unused lanes have face -1 and zero edges, which no ray can hit
+//
+struct TriangleBlock {
+	SIMD_ALIGN float v0[3][SIMD_WIDTH];
+	SIMD_ALIGN float e1[3][SIMD_WIDTH];
+	SIMD_ALIGN float e2[3][SIMD_WIDTH];
+	SIMD_ALIGN float n[3][SIMD_WIDTH];
+	int face[SIMD_WIDTH];
+};
+
+
+//  ***
+//  Object space triangle BVH for a single Mesh
+//  Built once with a binned SAH (surface area heuristic) builder, large
+//  subtrees are built on separate threads. The mesh is welded into an indexed
+//  vertex buffer first, then stored in one of the layouts below; the ofMesh
+//  is not needed for tracing after the build.
+//
+class MeshBVH {
+public:
+	// // // VARIABLES // // //
+
+	//  storage of the nodes and triangles, chosen when the tree is built
+	//		FULL		binary nodes with float boxes, triangles copied into SIMD blocks (fastest)
+	//		COMPACT		8 wide nodes with 8 bit child boxes, triangles index the welded vertices
+	//		COMPACT16	COMPACT with vertex positions quantized to 16 bits per axis (smallest)
+	//
+	enum Layout { FULL, COMPACT, COMPACT16 };
+
+	int numTriangles = 0, numVertices = 0;	// after welding
+	size_t buildBytes = 0;					// most the last build held at once, temporaries and result
+
+	// // // FUNCTIONS // // //
+
+	void build(const ofMesh &mesh, Layout layout = FULL);
+
+	// the same for an indexed triangle list that has no two vertices at the same
+	// position already (see MeshLoader), the welding pass is skipped
+	// a trailing partial triangle is ignored
+	//
+	void build(const vector<glm::vec3> &verts, const vector<uint32_t> &tri, Layout layout = FULL);
+
+	// closest front facing triangle along the ray (p, d) in object space
+	// t is the distance along d, face identifies the triangle (its index in the mesh
+	// for FULL, its position in the leaf ordered index buffer otherwise)
+	// and normal is its object space face normal
+	//
+	bool intersect(const glm::vec3 &p, const glm::vec3 &d, float &t, int &face, glm::vec3 &normal) const;
+
+	// true if a front facing triangle is hit at 0 <= t < tMax, d does not have to be unit length
+	//
+	bool occluded(const glm::vec3 &p, const glm::vec3 &d, float tMax) const;
+
+	AABB bounds() const { return rootBox; }
+	Layout getLayout() const { return layout; }
+
+	// bytes held by the nodes and triangle data of the current layout
+	//
+	size_t memoryUsage() const;
+
+private:
+	// // // VARIABLES // // //
+
+	// flattened depth first like SceneBVH, the left child of node i is i + 1
+	//
+	struct Node {
+		AABB box;
+		int right = -1;
+		int start = 0;
+		int count = 0;
+	};
+
+	// compressed node of the compact layouts, up to 8 children
+	// child boxes are stored relative to the node's box as bytes:
+	//		child min = origin + lo * 2^exponent (rounded down), max likewise with hi (rounded up)
+	//
+	struct WideNode {
+		glm::vec3 origin;
+		int8_t exponent[3];
+		uint8_t numChildren = 0;
+		uint8_t lo[3][8], hi[3][8];
+		uint8_t count[8];		// triangles in a leaf child, 0 for an inner child
+		int child[8];			// index into wnodes (inner) or first triangle in tris (leaf)
+	};
+
+	// temporary tree produced by the (parallel) builder before it is flattened
+	//
+	struct BuildNode {
+		AABB box;
+		int start = 0, count = 0;
+		std::unique_ptr<BuildNode> left, right;
+	};
+
+	Layout layout = FULL;
+	AABB rootBox;
+	vector<int> indices;			// triangle indices ordered by leaf (build only)
+
+	// FULL
+	vector<Node> nodes;
+	vector<TriangleBlock, SimdAllocator<TriangleBlock>> blocks;	// leaf triangles, a leaf starts at block nodes[i].start
+
+	// COMPACT, COMPACT16
+	vector<WideNode> wnodes;
+	vector<uint32_t> tris;			// 3 vertex indices per triangle, in leaf order
+	vector<glm::vec3> vertices;		// COMPACT
+	vector<uint16_t> qvertices;		// COMPACT16, 3 per vertex: position = qOrigin + q * qScale
+	glm::vec3 qOrigin, qScale;
+
+	const static int maxLeafSize = SIMD_WIDTH;	// never split, larger leaves (up to 4 times as many
+												// triangles, several blocks) stay when no split is cheaper
+	const static int numBins = 16;
+	const static int parallelThreshold = 4096;	// smallest subtree handed to another thread
+	const static int medianDepth = 40;			// tree depth from which nodes are split at the median
+	const static int maxTreeDepth = 60;			// and made leaves, traversal stacks hold 64 nodes
+
+	// // // FUNCTIONS // // //
+
+	std::unique_ptr<BuildNode> buildNode(vector<AABB> &boxes, vector<glm::vec3> &centers, int start, int end, int depth);
+	void flatten(const BuildNode *b, const vector<glm::vec3> &verts, const vector<uint32_t> &tri);
+	void addBlocks(int start, int count, const vector<glm::vec3> &verts, const vector<uint32_t> &tri);
+
+	void quantize(vector<glm::vec3> &verts);
+	int collapse(const BuildNode *b, const vector<uint32_t> &tri);
+	static size_t countNodes(const BuildNode *b);
+	bool traverseWide(const glm::vec3 &p, const glm::vec3 &d, float tMax, bool anyHit, float &t, int &face, glm::vec3 &normal) const;
+
+	glm::vec3 vertex(uint32_t i) const {
+		if (layout == COMPACT16)
+			return qOrigin + glm::vec3(qvertices[3 * i], qvertices[3 * i + 1], qvertices[3 * i + 2]) * qScale;
+		return vertices[i];
+	}
+};
@@ -0,0 +1,638 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+//
+//  Compiled scene: building the typed arrays and the single ray
+//  traversal with its kernels (the packet traversal is in packet.cpp)
+//
+
+#include "compiledscene.h"
+#include "Primitives.h"
+
+
+// // // BUILDING // // //
+
+
+void CompiledScene::clear() {
+	spheres.clear();
+	cubes.clear();
+	planes.clear();
+	meshes.clear();
+	refs.clear();
+	nodes.clear();
+	leaves.clear();
+	unbounded = Leaf();
+}
+
+
+//  ***
+//  sort the objects into their kinds and build the tree over their world bounds
+//  getBounds() brings the cached matrices up to date before they are copied
+//
+void CompiledScene::build(const vector<SceneObject *> &objects) {
+	clear();
+	refs.resize(objects.size());
+
+	vector<BuildItem> items, loose;
+	for (size_t i = 0; i < objects.size(); i++) {
+		SceneObject *o = objects[i];
+		const std::type_info &type = typeid(*o);
+		int kind = (type == typeid(Sphere)) ? SPHERES : (type == typeid(Cube)) ? CUBES :
+				   (type == typeid(Plane)) ? PLANES : (type == typeid(Mesh)) ? MESHES : NONE;
+		if (kind == NONE) continue;		// lights
+
+		BuildItem item;
+		item.box = o->getBounds();
+		item.center = item.box.center();
+		item.object = o;
+		item.kind = kind;
+		item.id = i;
+
+		if (item.box.isFinite()) items.push_back(item);
+		else loose.push_back(item);
+	}
+
+	unbounded = emitLeaf(loose, 0, loose.size());
+
+	if (items.size()) {
+		nodes.reserve(2 * items.size());
+		buildNode(items, 0, items.size(), 0);
+	}
+}
+
+
+//  ***
+//  tests a leaf costs: one per block of spheres or cubes, one per plane or mesh
+//
+float CompiledScene::leafCost(const int count[NUM_KINDS]) const {
+	return (float)((count[SPHERES] + BATCH_WIDTH - 1) / BATCH_WIDTH + (count[CUBES] + BATCH_WIDTH - 1) / BATCH_WIDTH +
+				   count[PLANES] + count[MESHES]);
+}
+
+
+//  ***
+//  binned SAH split of items[start, end) on the longest centroid axis
+//  a leaf is made when no split is cheaper and its spheres and cubes fit in one
+//  block each; objects that cannot be told apart by their centers are split in half
+//  so the tree fits the traversal stacks, objects are split in half from medianDepth
+//  on and whatever is left at maxTreeDepth becomes one leaf
+//
+int CompiledScene::buildNode(vector<BuildItem> &items, int start, int end, int depth) {
+	int n = nodes.size();
+	nodes.push_back(Node());
+
+	AABB box, centroids;
+	int count[NUM_KINDS] = {};
+	for (int i = start; i < end; i++) {
+		box.expand(items[i].box);
+		centroids.expand(items[i].center);
+		count[items[i].kind]++;
+	}
+	nodes[n].box = box;
+
+	bool fits = (count[SPHERES] <= BATCH_WIDTH && count[CUBES] <= BATCH_WIDTH);
+	float leafSAH = box.surfaceArea() * leafCost(count);
+
+	// costs are left multiplied by the node's area, a split costs one box test for the node
+	//
+	int axis = centroids.longestAxis();
+	float lo = centroids.min[axis], extent = centroids.max[axis] - lo;
+	float bestSAH = std::numeric_limits<float>::infinity();
+	int bestBin = -1;
+
+	auto binOf = [&](const BuildItem &item) {
+		return std::min(numBins - 1, (int)(numBins * (item.center[axis] - lo) / extent));
+	};
+
+	if (end - start > 1 && extent > 0 && depth < medianDepth) {
+		struct Bin { AABB box; int count[NUM_KINDS] = {}; };
+		Bin bins[numBins], right[numBins];
+
+		for (int i = start; i < end; i++) {
+			Bin &b = bins[binOf(items[i])];
+			b.box.expand(items[i].box);
+			b.count[items[i].kind]++;
+		}
+
+		// right[b] holds bins b .. numBins - 1
+		//
+		right[numBins - 1] = bins[numBins - 1];
+		for (int b = numBins - 2; b >= 0; b--) {
+			right[b] = right[b + 1];
+			right[b].box.expand(bins[b].box);
+			for (int k = 0; k < NUM_KINDS; k++) right[b].count[k] += bins[b].count[k];
+		}
+
+		Bin left;
+		for (int b = 1; b < numBins; b++) {
+			left.box.expand(bins[b - 1].box);
+			for (int k = 0; k < NUM_KINDS; k++) left.count[k] += bins[b - 1].count[k];
+			if (left.box.isEmpty() || right[b].box.isEmpty()) continue;
+
+			float sah = box.surfaceArea() + left.box.surfaceArea() * leafCost(left.count) +
+						right[b].box.surfaceArea() * leafCost(right[b].count);
+			if (sah < bestSAH) {
+				bestSAH = sah;
+				bestBin = b;
+			}
+		}
+	}
+
+	if (end - start == 1 || (fits && leafSAH <= bestSAH) || depth >= maxTreeDepth) {
+		nodes[n].leaf = leaves.size();
+		leaves.push_back(emitLeaf(items, start, end));
+		return n;
+	}
+
+	int mid;
+	if (bestBin >= 0) {
+		mid = std::partition(items.begin() + start, items.begin() + end,
+			[&](const BuildItem &item) { return binOf(item) < bestBin; }) - items.begin();
+	}
+	else {
+		mid = (start + end) / 2;
+		std::nth_element(items.begin() + start, items.begin() + mid, items.begin() + end,
+			[&](const BuildItem &a, const BuildItem &b) { return a.center[axis] < b.center[axis]; });
+	}
+
+	buildNode(items, start, mid, depth + 1);
+	int right = buildNode(items, mid, end, depth + 1);
+	nodes[n].right = right;
+	return n;
+}
+
+
+//  ***
+//  copy the objects of a leaf into the arrays of their kinds, spheres and cubes
+//  fill blocks from lane 0, the lanes left over stay unused
+//
+CompiledScene::Leaf CompiledScene::emitLeaf(const vector<BuildItem> &items, int start, int end) {
+	Leaf leaf;
+	leaf.first[SPHERES] = spheres.size();
+	leaf.first[CUBES] = cubes.size();
+	leaf.first[PLANES] = planes.size();
+	leaf.first[MESHES] = meshes.size();
+
+	int numSpheres = 0, numCubes = 0;
+
+	for (int i = start; i < end; i++) {
+		const BuildItem &item = items[i];
+		const glm::mat4 &mInv = item.object->worldInverse;
+		Ref &ref = refs[item.id];
+		ref.kind = item.kind;
+
+		switch (item.kind) {
+		case SPHERES: {
+			if (numSpheres % BATCH_WIDTH == 0) spheres.push_back(SphereBlock());
+			SphereBlock &b = spheres.back();
+			int lane = numSpheres++ % BATCH_WIDTH;
+
+			for (int r = 0; r < 3; r++)
+				for (int c = 0; c < 4; c++)
+					b.m[4 * r + c][lane] = mInv[c][r];
+			float radius = ((Sphere *)item.object)->radius;
+			b.r2[lane] = radius * radius;
+			b.id[lane] = item.id;
+			b.lanes |= 1 << lane;
+
+			ref.index = spheres.size() - 1;
+			ref.lane = lane;
+			break;
+		}
+
+		case CUBES: {
+			if (numCubes % BATCH_WIDTH == 0) cubes.push_back(CubeBlock());
+			CubeBlock &b = cubes.back();
+			int lane = numCubes++ % BATCH_WIDTH;
+
+			for (int r = 0; r < 3; r++)
+				for (int c = 0; c < 4; c++)
+					b.m[4 * r + c][lane] = mInv[c][r];
+			Cube *cube = (Cube *)item.object;
+			b.half[0][lane] = cube->width / 2.0f;
+			b.half[1][lane] = cube->height / 2.0f;
+			b.half[2][lane] = cube->depth / 2.0f;
+			b.id[lane] = item.id;
+			b.lanes |= 1 << lane;
+
+			ref.index = cubes.size() - 1;
+			ref.lane = lane;
+			break;
+		}
+
+		case PLANES: {
+			Plane *plane = (Plane *)item.object;
+			planes.push_back({ plane->position, plane->normal, plane->width / 2, plane->height / 2, item.id });
+			ref.index = planes.size() - 1;
+			break;
+		}
+
+		case MESHES:
+			meshes.push_back({ mInv, &((Mesh *)item.object)->geometry->bvh, item.id });
+			ref.index = meshes.size() - 1;
+			break;
+		}
+	}
+
+	leaf.count[SPHERES] = spheres.size() - leaf.first[SPHERES];
+	leaf.count[CUBES] = cubes.size() - leaf.first[CUBES];
+	leaf.count[PLANES] = planes.size() - leaf.first[PLANES];
+	leaf.count[MESHES] = meshes.size() - leaf.first[MESHES];
+	return leaf;
+}
+
+
+// // // SINGLE RAY TRAVERSAL // // //
+
+
+int CompiledScene::idOf(int kind, int index, int lane) const {
+	switch (kind) {
+	case SPHERES: return spheres[index].id[lane];
+	case CUBES: return cubes[index].id[lane];
+	case PLANES: return planes[index].id;
+	case MESHES: return meshes[index].id;
+	}
+	return -1;
+}
+
+
+//  ***
+//  closest hit: the hinted object, the unbounded ones, then the tree
+//
+bool CompiledScene::intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, int &obj, int hint) const {
+	RayLanes r(ray);
+	Nearest near;
+
+	if (isCacheable(hint)) testRef(refs[hint], ray, r, near);
+	testLeaf(unbounded, ray, r, near);
+	if (nodes.size()) traverse(0, ray, r, near);
+
+	if (near.kind == NONE) return false;
+
+	point = ray.evalPoint(near.t);
+	normal = normalAt(ray, near);
+	obj = idOf(near.kind, near.index, near.lane);
+	return true;
+}
+
+
+//  ***
+//  closest hit below root, only hits nearer than near.t are reported
+//  children are visited near to far, like SceneBVH::traverse
+//
+bool CompiledScene::traverse(int root, const Ray &ray, const RayLanes &r, Nearest &near) const {
+	int stack[64], top = 0;
+	float tEntry, tLeft, tRight;
+	bool hit = false;
+
+	if (!nodes[root].box.intersect(ray.p, ray.invD, near.t, tEntry)) return false;
+	stack[top++] = root;
+
+	while (top) {
+		int n = stack[--top];
+		const Node &node = nodes[n];
+
+		if (node.leaf >= 0) {
+			hit |= testLeaf(leaves[node.leaf], ray, r, near);
+			continue;
+		}
+
+		int left = n + 1, right = node.right;
+		bool hitL = nodes[left].box.intersect(ray.p, ray.invD, near.t, tLeft);
+		bool hitR = nodes[right].box.intersect(ray.p, ray.invD, near.t, tRight);
+
+		if (hitL && hitR) {
+			if (tLeft < tRight) { stack[top++] = right; stack[top++] = left; }
+			else { stack[top++] = left; stack[top++] = right; }
+		}
+		else if (hitL) stack[top++] = left;
+		else if (hitR) stack[top++] = right;
+	}
+
+	return hit;
+}
+
+
+bool CompiledScene::testLeaf(const Leaf &leaf, const Ray &ray, const RayLanes &r, Nearest &near) const {
+	bool hit = false;
+
+	for (int b = leaf.first[SPHERES]; b < leaf.first[SPHERES] + leaf.count[SPHERES]; b++) {
+		int lane = intersectSpheres(spheres[b], spheres[b].lanes, r, near.t);
+		if (lane >= 0) {
+			near.kind = SPHERES;
+			near.index = b;
+			near.lane = lane;
+			hit = true;
+		}
+	}
+
+	for (int b = leaf.first[CUBES]; b < leaf.first[CUBES] + leaf.count[CUBES]; b++) {
+		int lane = intersectCubes(cubes[b], cubes[b].lanes, r, near.t);
+		if (lane >= 0) {
+			near.kind = CUBES;
+			near.index = b;
+			near.lane = lane;
+			hit = true;
+		}
+	}
+
+	for (int i = leaf.first[PLANES]; i < leaf.first[PLANES] + leaf.count[PLANES]; i++) {
+		if (intersectPlane(planes[i], ray, near.t)) {
+			near.kind = PLANES;
+			near.index = i;
+			near.lane = 0;
+			near.normal = planes[i].normal;
+			hit = true;
+		}
+	}
+
+	for (int i = leaf.first[MESHES]; i < leaf.first[MESHES] + leaf.count[MESHES]; i++) {
+		if (intersectMesh(meshes[i], ray, near.t, near.normal)) {
+			near.kind = MESHES;
+			near.index = i;
+			near.lane = 0;
+			hit = true;
+		}
+	}
+
+	return hit;
+}
+
+
+//  ***
+//  a hinted object: its whole block costs the same as the object alone
+//
+void CompiledScene::testRef(const Ref &ref, const Ray &ray, const RayLanes &r, Nearest &near) const {
+	Leaf leaf;
+	leaf.first[ref.kind] = ref.index;
+	leaf.count[ref.kind] = 1;
+	testLeaf(leaf, ray, r, near);
+}
+
+
+//  ***
+//  world normal of the closest hit, for spheres and cubes from the object space
+//  hit point like the packet kernels (not normalized, as Sphere::intersect)
+//
+glm::vec3 CompiledScene::normalAt(const Ray &ray, const Nearest &near) const {
+	if (near.kind != SPHERES && near.kind != CUBES) return near.normal;
+
+	const float (*m)[BATCH_WIDTH] = (near.kind == SPHERES) ? spheres[near.index].m : cubes[near.index].m;
+	glm::mat4 mInv = laneInverse(m, near.lane);
+	glm::vec3 o = mInv * glm::vec4(ray.p, 1.0);
+	glm::vec3 d = mInv * glm::vec4(ray.d, 0.0);
+	glm::vec3 n;
+
+	if (near.kind == SPHERES)
+		n = (o + near.t * d) / sqrtf(spheres[near.index].r2[near.lane]);
+	else {
+		// face entered last, see the cube kernel
+		//
+		glm::vec3 tNear;
+		for (int i = 0; i < 3; i++) {
+			float half = cubes[near.index].half[i][near.lane];
+			float inv = 1.0f / d[i];
+			tNear[i] = std::min((-half - o[i]) * inv, (half - o[i]) * inv);
+		}
+		int axis = (tNear.x >= tNear.y && tNear.x >= tNear.z) ? 0 : (tNear.y >= tNear.z) ? 1 : 2;
+		n = glm::vec3(0);
+		n[axis] = (d[axis] < 0) ? 1.0f : -1.0f;
+	}
+
+	return glm::vec4(n, 0.0) * mInv;
+}
+
+
+// // // SHADOW RAYS // // //
+
+
+//  ***
+//  any hit traversal, returns on the first occluder found before tMax
+//
+bool CompiledScene::occluded(const Ray &ray, float tMax, int ignore, int *occluder) const {
+	RayLanes r(ray);
+	Ref skip = isCacheable(ignore) ? refs[ignore] : Ref();
+
+	if (occludedLeaf(unbounded, ray, r, tMax, skip, occluder)) return true;
+	if (nodes.empty()) return false;
+
+	int stack[64], top = 0;
+	float tEntry;
+	stack[top++] = 0;
+
+	while (top) {
+		int n = stack[--top];
+		const Node &node = nodes[n];
+		if (!node.box.intersect(ray.p, ray.invD, tMax, tEntry)) continue;
+
+		if (node.leaf >= 0) {
+			if (occludedLeaf(leaves[node.leaf], ray, r, tMax, skip, occluder)) return true;
+		}
+		else {
+			stack[top++] = node.right;
+			stack[top++] = n + 1;
+		}
+	}
+
+	return false;
+}
+
+
+//  ***
+//  the block kernels find the nearest blocker of a block, any of them will do
+//
+bool CompiledScene::occludedLeaf(const Leaf &leaf, const Ray &ray, const RayLanes &r, float tMax,
+								 const Ref &ignore, int *occluder) const {
+	int found = -1;
+
+	for (int b = leaf.first[SPHERES]; b < leaf.first[SPHERES] + leaf.count[SPHERES] && found < 0; b++) {
+		int lanes = spheres[b].lanes;
+		if (ignore.kind == SPHERES && ignore.index == b) lanes &= ~(1 << ignore.lane);
+
+		float t = tMax;
+		int lane = intersectSpheres(spheres[b], lanes, r, t);
+		if (lane >= 0) found = spheres[b].id[lane];
+	}
+
+	for (int b = leaf.first[CUBES]; b < leaf.first[CUBES] + leaf.count[CUBES] && found < 0; b++) {
+		int lanes = cubes[b].lanes;
+		if (ignore.kind == CUBES && ignore.index == b) lanes &= ~(1 << ignore.lane);
+
+		float t = tMax;
+		int lane = intersectCubes(cubes[b], lanes, r, t);
+		if (lane >= 0) found = cubes[b].id[lane];
+	}
+
+	for (int i = leaf.first[PLANES]; i < leaf.first[PLANES] + leaf.count[PLANES] && found < 0; i++) {
+		float t = tMax;
+		if (!(ignore.kind == PLANES && ignore.index == i) && intersectPlane(planes[i], ray, t))
+			found = planes[i].id;
+	}
+
+	for (int i = leaf.first[MESHES]; i < leaf.first[MESHES] + leaf.count[MESHES] && found < 0; i++) {
+		if (!(ignore.kind == MESHES && ignore.index == i) && occludedMesh(meshes[i], ray, tMax))
+			found = meshes[i].id;
+	}
+
+	if (found < 0) return false;
+	if (occluder) *occluder = found;
+	return true;
+}
+
+
+bool CompiledScene::occludedBy(int obj, const Ray &ray, float tMax) const {
+	if (!isCacheable(obj)) return false;
+
+	const Ref &ref = refs[obj];
+	float t = tMax;
+
+	switch (ref.kind) {
+	case SPHERES: return intersectSpheres(spheres[ref.index], 1 << ref.lane, RayLanes(ray), t) >= 0;
+	case CUBES: return intersectCubes(cubes[ref.index], 1 << ref.lane, RayLanes(ray), t) >= 0;
+	case PLANES: return intersectPlane(planes[ref.index], ray, t);
+	case MESHES: return occludedMesh(meshes[ref.index], ray, tMax);
+	}
+	return false;
+}
+
+
+// // // KERNELS // // //
+
+
+//  ***
+//  ray / sphere for a block: |o + td|^2 = r^2 in the space of each sphere
+//  the direction is not renormalized, so t is the world space distance
+//  the nearest root in front of the ray is used, like the packet kernel
+//
+int CompiledScene::intersectSpheres(const SphereBlock &b, int lanes, const RayLanes &r, float &near_t) const {
+	SIMD_ALIGN float tLanes[SIMD_WIDTH];
+	int hitLane = -1;
+
+	for (int j = 0; j < BATCH_WIDTH; j += SIMD_WIDTH) {
+		int bits = (lanes >> j) & SIMD_ALL;
+		if (!bits) continue;
+
+		vfloat o[3], d[3];
+		for (int i = 0; i < 3; i++) {
+			vfloat m0 = vfloat::load(&b.m[4 * i][j]), m1 = vfloat::load(&b.m[4 * i + 1][j]);
+			vfloat m2 = vfloat::load(&b.m[4 * i + 2][j]), m3 = vfloat::load(&b.m[4 * i + 3][j]);
+			o[i] = r.p[0] * m0 + r.p[1] * m1 + r.p[2] * m2 + m3;
+			d[i] = r.d[0] * m0 + r.d[1] * m1 + r.d[2] * m2;
+		}
+
+		vfloat a = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+		vfloat bh = o[0] * d[0] + o[1] * d[1] + o[2] * d[2];
+		vfloat c = o[0] * o[0] + o[1] * o[1] + o[2] * o[2] - vfloat::load(&b.r2[j]);
+		vfloat disc = bh * bh - a * c;
+
+		vfloat sq = vsqrt(vmax(disc, 0.0f));
+		vfloat tNear = (-bh - sq) / a;
+		vfloat tFar = (-bh + sq) / a;
+		vfloat t = select(tNear > 0.0f, tNear, tFar);
+
+		int m = bits & mask((disc >= 0.0f) & (t > 0.0f) & (t < vfloat(near_t)));
+		if (!m) continue;
+
+		t.store(tLanes);
+		for (int k = 0; k < SIMD_WIDTH; k++) {
+			if ((m & (1 << k)) && tLanes[k] < near_t) {
+				near_t = tLanes[k];
+				hitLane = j + k;
+			}
+		}
+	}
+
+	return hitLane;
+}
+
+
+//  ***
+//  slab test for a block of cubes, each in its own space
+//  rays starting inside a cube enter it behind the origin and miss, like Cube::intersect
+//
+int CompiledScene::intersectCubes(const CubeBlock &b, int lanes, const RayLanes &r, float &near_t) const {
+	SIMD_ALIGN float tLanes[SIMD_WIDTH];
+	int hitLane = -1;
+
+	for (int j = 0; j < BATCH_WIDTH; j += SIMD_WIDTH) {
+		int bits = (lanes >> j) & SIMD_ALL;
+		if (!bits) continue;
+
+		vfloat tmin = -std::numeric_limits<float>::infinity(), tmax = std::numeric_limits<float>::infinity();
+		for (int i = 0; i < 3; i++) {
+			vfloat m0 = vfloat::load(&b.m[4 * i][j]), m1 = vfloat::load(&b.m[4 * i + 1][j]);
+			vfloat m2 = vfloat::load(&b.m[4 * i + 2][j]), m3 = vfloat::load(&b.m[4 * i + 3][j]);
+			vfloat o = r.p[0] * m0 + r.p[1] * m1 + r.p[2] * m2 + m3;
+			vfloat d = r.d[0] * m0 + r.d[1] * m1 + r.d[2] * m2;
+
+			vfloat half = vfloat::load(&b.half[i][j]);
+			vfloat inv = 1.0f / d;
+			vfloat t0 = (-half - o) * inv;
+			vfloat t1 = (half - o) * inv;
+			tmin = vmax(tmin, vmin(t0, t1));
+			tmax = vmin(tmax, vmax(t0, t1));
+		}
+
+		int m = bits & mask((tmin <= tmax) & (tmin > 0.0f) & (tmin < vfloat(near_t)));
+		if (!m) continue;
+
+		tmin.store(tLanes);
+		for (int k = 0; k < SIMD_WIDTH; k++) {
+			if ((m & (1 << k)) && tLanes[k] < near_t) {
+				near_t = tLanes[k];
+				hitLane = j + k;
+			}
+		}
+	}
+
+	return hitLane;
+}
+
+
+//  ***
+//  world space plane, hit from either side like Plane::occluded
+//
+bool CompiledScene::intersectPlane(const PlaneItem &pl, const Ray &ray, float &near_t) const {
+	float den = glm::dot(ray.d, pl.normal);
+	if (fabs(den) <= std::numeric_limits<float>::epsilon()) return false;
+
+	float t = glm::dot(pl.position - ray.p, pl.normal) / den;
+	if (t <= 0 || t >= near_t) return false;
+
+	glm::vec3 pt = ray.p + t * ray.d;
+	if (!(pt.x > pl.position.x - pl.halfWidth && pt.x < pl.position.x + pl.halfWidth &&
+		  pt.z > pl.position.z - pl.halfHeight && pt.z < pl.position.z + pl.halfHeight)) return false;
+
+	near_t = t;
+	return true;
+}
+
+
+//  ***
+//  the instance's triangles in object space, the direction keeps its length so the
+//  mesh BVH returns world space t
+//
+bool CompiledScene::intersectMesh(const MeshItem &mi, const Ray &ray, float &near_t, glm::vec3 &normal) const {
+	glm::vec3 p = mi.inverse * glm::vec4(ray.p, 1.0);
+	glm::vec3 d = mi.inverse * glm::vec4(ray.d, 0.0);
+	float t;
+	int face;
+	glm::vec3 n;
+
+	if (!mi.bvh->intersect(p, d, t, face, n) || t <= 0 || t >= near_t) return false;
+
+	near_t = t;
+	normal = glm::vec4(n, 0.0) * mi.inverse;
+	return true;
+}
+
+
+bool CompiledScene::occludedMesh(const MeshItem &mi, const Ray &ray, float tMax) const {
+	glm::vec3 p = mi.inverse * glm::vec4(ray.p, 1.0);
+	glm::vec3 d = mi.inverse * glm::vec4(ray.d, 0.0);
+	return mi.bvh->occluded(p, d, tMax);
+}
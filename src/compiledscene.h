@@ -0,0 +1,208 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#pragma once
+
+#include "ofMain.h"
+#include "ray.h"
+#include "bvh.h"
+#include "packet.h"
+
+class SceneObject;
+
+//  ***
+//  objects in one block of the sphere and cube kernels
+//  (one AVX register, two SSE ones)
+//
+const int BATCH_WIDTH = 8;
+
+
+//  ***
+//  Render time form of the scene geometry, compiled from the objects of a
+//  RenderScene when it is prepared
+//  Every object is copied into the array of its kind with the object space data its
+//  kernel reads: spheres and cubes in blocks of BATCH_WIDTH stored as structures of
+//  arrays, so a single ray is tested against the whole block at once, planes and mesh
+//  instances one by one. Lights are left out, camera and shadow rays never hit them.
+//  The kind is decided once here, tracing is plain loops over the arrays with no
+//  virtual calls or type tests. The tree over the objects has leaves that hold a run
+//  of blocks / items of each kind, built with the SAH counting a block as one test.
+//  Hits report the index of the object in the list the scene was compiled from, like
+//  SceneBVH (which stays the editor's structure for picking).
+//
+class CompiledScene {
+public:
+	// // // FUNCTIONS // // //
+
+	void build(const vector<SceneObject *> &objects);
+	void clear();
+
+	// closest hit along the ray, obj returns the index of the object
+	// hint is an object likely to be hit, tested first (see SceneBVH::intersect), -1 for none
+	//
+	bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal, int &obj, int hint = -1) const;
+
+	// true if an object other than ignore is hit at 0 < t < tMax, the first occluder
+	// found is returned in occluder when it is given
+	//
+	bool occluded(const Ray &ray, float tMax, int ignore, int *occluder = NULL) const;
+
+	// the same test for a single object (an occluder cached by the caller)
+	//
+	bool occludedBy(int obj, const Ray &ray, float tMax) const;
+
+	// closest hit for every active lane of a packet, split into single rays once
+	// only one lane is left in a subtree; hint is tested first like in intersect()
+	//
+	void intersectPacket(const RayPacket &rays, PacketHit &hit, int hint = -1) const;
+
+	// an object can be given as a hint / occluder cache entry
+	//
+	bool isCacheable(int i) const { return i >= 0 && i < (int)refs.size() && refs[i].kind != NONE; }
+
+private:
+	// // // VARIABLES // // //
+
+	enum Kind { SPHERES, CUBES, PLANES, MESHES, NUM_KINDS, NONE = -1 };
+
+	// the world inverse of each lane, rows 0 - 2 of the affine part:
+	// m[4 * r + c] is column c of row r, the object space point is m * (p, 1)
+	//
+	struct SphereBlock {
+		SIMD_ALIGN float m[12][BATCH_WIDTH];
+		SIMD_ALIGN float r2[BATCH_WIDTH];		// radius^2
+		int id[BATCH_WIDTH];
+		int lanes = 0;							// one bit per lane that holds a sphere
+	};
+
+	struct CubeBlock {
+		SIMD_ALIGN float m[12][BATCH_WIDTH];
+		SIMD_ALIGN float half[3][BATCH_WIDTH];	// half width, height and depth
+		int id[BATCH_WIDTH];
+		int lanes = 0;
+	};
+
+	// planes are traced in world space like Plane::intersect
+	//
+	struct PlaneItem {
+		glm::vec3 position, normal;
+		float halfWidth, halfHeight;
+		int id;
+	};
+
+	struct MeshItem {
+		glm::mat4 inverse;
+		const MeshBVH *bvh;		// owned by the mesh's geometry, which the scene keeps alive
+		int id;
+	};
+
+	// where an object was compiled to: its block and lane, or its item (lane 0)
+	//
+	struct Ref {
+		int kind = NONE;
+		int index = 0, lane = 0;
+	};
+
+	// runs of each kind in a leaf: blocks for spheres and cubes, items otherwise
+	//
+	struct Leaf {
+		int first[NUM_KINDS] = {}, count[NUM_KINDS] = {};
+	};
+
+	// depth first like SceneBVH, the left child of node i is i + 1
+	//
+	struct Node {
+		AABB box;
+		int right = -1;		// inner node
+		int leaf = -1;		// index into leaves, -1 for inner nodes
+	};
+
+	// closest hit so far of a single ray, the normal is only found for the
+	// sphere or cube hit last (normalAt), planes and meshes produce it with the hit
+	//
+	struct Nearest {
+		float t = std::numeric_limits<float>::infinity();
+		int kind = NONE, index = 0, lane = 0;
+		glm::vec3 normal;
+	};
+
+	// a ray broadcast to every lane, for the block kernels
+	//
+	struct RayLanes {
+		vfloat p[3], d[3];
+		RayLanes(const Ray &ray) {
+			for (int i = 0; i < 3; i++) {
+				p[i] = ray.p[i];
+				d[i] = ray.d[i];
+			}
+		}
+	};
+
+	// an object as the builder sees it
+	//
+	struct BuildItem {
+		AABB box;
+		glm::vec3 center;
+		SceneObject *object;
+		int kind, id;
+	};
+
+	vector<SphereBlock, SimdAllocator<SphereBlock>> spheres;	// aligned for the vfloat loads
+	vector<CubeBlock, SimdAllocator<CubeBlock>> cubes;
+	vector<PlaneItem> planes;
+	vector<MeshItem> meshes;
+	vector<Ref> refs;			// per object index
+	vector<Node> nodes;
+	vector<Leaf> leaves;
+	Leaf unbounded;				// objects that cannot be bounded, always tested
+
+	const static int numBins = 16;
+	const static int medianDepth = 40;		// tree depth from which nodes are split at the median
+	const static int maxTreeDepth = 60;		// and made leaves, traversal stacks hold 64 nodes
+
+	// // // FUNCTIONS // // //
+
+	int buildNode(vector<BuildItem> &items, int start, int end, int depth);
+	Leaf emitLeaf(const vector<BuildItem> &items, int start, int end);
+	float leafCost(const int count[NUM_KINDS]) const;
+
+	bool traverse(int root, const Ray &ray, const RayLanes &r, Nearest &near) const;
+	bool testLeaf(const Leaf &leaf, const Ray &ray, const RayLanes &r, Nearest &near) const;
+	void testRef(const Ref &ref, const Ray &ray, const RayLanes &r, Nearest &near) const;
+	bool occludedLeaf(const Leaf &leaf, const Ray &ray, const RayLanes &r, float tMax, const Ref &ignore, int *occluder) const;
+	glm::vec3 normalAt(const Ray &ray, const Nearest &near) const;
+	int idOf(int kind, int index, int lane) const;
+
+	// single ray kernels, hits at 0 < t < near_t lower near_t
+	// the block ones test the lanes set in lanes and return the lane of the nearest hit, -1 for none
+	//
+	int intersectSpheres(const SphereBlock &b, int lanes, const RayLanes &r, float &near_t) const;
+	int intersectCubes(const CubeBlock &b, int lanes, const RayLanes &r, float &near_t) const;
+	bool intersectPlane(const PlaneItem &pl, const Ray &ray, float &near_t) const;
+	bool intersectMesh(const MeshItem &mi, const Ray &ray, float &near_t, glm::vec3 &normal) const;
+	bool occludedMesh(const MeshItem &mi, const Ray &ray, float tMax) const;
+
+	// packet kernels (packet.cpp), one object against every lane in lanes
+	//
+	int packetLanes(const Node &node, const RayPacket &rays, const PacketHit &hit, int lanes) const;
+	void packetLeaf(const Leaf &leaf, const RayPacket &rays, int lanes, PacketHit &hit) const;
+	void packetRef(const Ref &ref, const RayPacket &rays, int lanes, PacketHit &hit) const;
+	void packetSphere(const SphereBlock &b, int lane, const RayPacket &rays, int lanes, PacketHit &hit) const;
+	void packetCube(const CubeBlock &b, int lane, const RayPacket &rays, int lanes, PacketHit &hit) const;
+	void packetPlane(const PlaneItem &pl, const RayPacket &rays, int lanes, PacketHit &hit) const;
+	void packetMesh(const MeshItem &mi, const RayPacket &rays, int lanes, PacketHit &hit) const;
+
+	// world inverse of a block lane as a matrix
+	//
+	static glm::mat4 laneInverse(const float m[12][BATCH_WIDTH], int lane) {
+		glm::mat4 inv(1.0f);
+		for (int r = 0; r < 3; r++)
+			for (int c = 0; c < 4; c++)
+				inv[c][r] = m[4 * r + c][lane];
+		return inv;
+	}
+};
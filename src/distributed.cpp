@@ -0,0 +1,743 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#include "distributed.h"
+#include <thread>
+
+
+// // // MESSAGES // // //
+
+
+enum MessageType : char {
+	MSG_HELLO = 'h',		// worker -> coordinator: int threads
+	MSG_ALIVE = 'a',		// worker -> coordinator: still rendering
+	MSG_IMAGE = 'i',		// worker -> coordinator: int job, int frame, int width, int height, RGB bytes
+	MSG_SCENE = 's',		// coordinator -> worker: int job, RenderScene::serialize()
+	MSG_FRAME = 'f',		// coordinator -> worker: int job, int frame
+	MSG_DONE = 'd'			// coordinator -> worker: drop the frames not rendered yet
+};
+
+static const uint32_t maxMessage = 1 << 30;
+static const uint32_t sceneMagic = 0x32415452;		// "RTA2"
+
+
+//  ***
+//  values appended to / read from a byte string in the host's byte order
+//  reading past the end clears ok instead of reading garbage
+//
+class Packer {
+public:
+	string data;
+
+	template <class T> void put(const T &v) {
+		data.append((const char *)&v, sizeof(T));
+	}
+	template <class T> void putArray(const vector<T> &v) {
+		put((uint32_t)v.size());
+		data.append((const char *)v.data(), v.size() * sizeof(T));
+	}
+};
+
+class Unpacker {
+public:
+	bool ok = true;
+
+	Unpacker(const string &d) : data(d) {}
+
+	template <class T> void get(T &v) {
+		if (data.size() - at < sizeof(T)) { ok = false; return; }
+		memcpy(&v, data.data() + at, sizeof(T));
+		at += sizeof(T);
+	}
+	template <class T> void getArray(vector<T> &v) {
+		uint32_t n = 0;
+		get(n);
+		if (!ok || n > (data.size() - at) / sizeof(T)) { ok = false; return; }
+		v.resize(n);
+		memcpy((char *)v.data(), data.data() + at, n * sizeof(T));
+		at += n * sizeof(T);
+	}
+
+private:
+	const string &data;
+	size_t at = 0;
+};
+
+
+static string message(char type, const string &payload) {
+	uint32_t n = payload.size() + 1;
+	string m((const char *)&n, 4);
+	m += type;
+	return m + payload;
+}
+
+
+//  ***
+//  take the first whole message off buffer, false if there is none yet
+//  (or the stream is corrupt, then bad is set)
+//
+static bool nextMessage(string &buffer, char &type, string &payload, bool &bad) {
+	uint32_t n;
+	if (buffer.size() < 4) return false;
+	memcpy(&n, buffer.data(), 4);
+	if (n == 0 || n > maxMessage) { bad = true; return false; }
+	if (buffer.size() < 4 + n) return false;
+
+	type = buffer[4];
+	payload.assign(buffer, 5, n - 1);
+	buffer.erase(0, 4 + n);
+	return true;
+}
+
+
+// // // SCENE TRANSFER // // //
+
+
+//  ***
+//  the snapshot with its keyframes, enough to build any frame with RenderScene(base, frame)
+//  mesh geometry is written once however many meshes share it
+//
+string RenderScene::serialize() const {
+	Packer p;
+	p.put(sceneMagic);
+	p.put(ambientColor);
+	p.put(bkgndColor);
+	p.put(tileSize);
+	p.put(lightCutoff);
+	p.put(lightBudget);
+	p.put(bManyLights);
+	p.put(bPackets);
+	p.put(bAdaptiveShadows);
+	p.put(shadowBatch);
+	p.put(penumbraScale);
+	p.put(samplePattern);
+	p.put(bAntialias);
+	p.put(aaSamples);
+	p.put(aaColor);
+	p.put(aaNormal);
+	p.put(filter);
+	p.put(renderCam.position);
+	p.put(renderCam.aim);
+	p.put(renderCam.view.min);
+	p.put(renderCam.view.max);
+	p.put(renderCam.view.rt);
+	p.put(renderCam.view.position);
+
+	vector<MeshGeometry *> geometry;
+	for (size_t i = 0; i < scene.size(); i++) {
+		Mesh *m = dynamic_cast<Mesh *>(scene[i]);
+		if (m && std::find(geometry.begin(), geometry.end(), m->geometry.get()) == geometry.end())
+			geometry.push_back(m->geometry.get());
+	}
+	p.put((int)geometry.size());
+	for (size_t g = 0; g < geometry.size(); g++) {
+		p.put(geometry[g]->bvh.getLayout());
+		p.putArray(geometry[g]->mesh.getVertices());
+		p.putArray(geometry[g]->mesh.getIndices());
+	}
+
+	p.put((int)scene.size());
+	for (size_t i = 0; i < scene.size(); i++) {
+		SceneObject *o = scene[i];
+		char type = typeid(*o) == typeid(Light) ? 'l' : typeid(*o) == typeid(Sphere) ? 's' :
+					typeid(*o) == typeid(Cube) ? 'c' : typeid(*o) == typeid(Mesh) ? 'm' :
+					typeid(*o) == typeid(Plane) ? 'p' : 0;
+		p.put(type);
+		p.put((int)(std::find(scene.begin(), scene.end(), o->parent) - scene.begin()));
+		p.put(o->position);
+		p.put(o->rotation);
+		p.put(o->scale);
+		p.put(o->pivot);
+		p.put(o->diffuseColor);
+		p.put(o->specularColor);
+		p.put(o->isSelectable);
+
+		for (int k = 0; k < o->keys.size(); k++) {
+			const Keyframe *f = o->keys[k];
+			p.put(f->frame);
+			p.put(f->function);
+			p.put(f->channels);
+			p.put(f->position);
+			p.put(f->rotation);
+			p.put(f->scale);
+			p.put(f->pivot);
+		}
+		p.put(-1);
+
+		switch (type) {
+		case 'l': {
+			Light *l = (Light *)o;
+			p.put(l->radius);
+			p.put(l->intensity);
+			p.put(l->power);
+			p.put(l->angle);
+			p.put(l->N);
+			p.put(l->type);
+			p.put(l->area.min);
+			p.put(l->area.max);
+			p.put(l->area.position);
+			break;
+		}
+		case 's': p.put(((Sphere *)o)->radius); break;
+		case 'c': {
+			Cube *c = (Cube *)o;
+			p.put(c->width);
+			p.put(c->height);
+			p.put(c->depth);
+			break;
+		}
+		case 'm':
+			p.put((int)(std::find(geometry.begin(), geometry.end(), ((Mesh *)o)->geometry.get()) - geometry.begin()));
+			break;
+		case 'p': {
+			Plane *pl = (Plane *)o;
+			p.put(pl->width);
+			p.put(pl->height);
+			p.put(pl->normal);
+			break;
+		}
+		default:
+			std::cout << "cannot send " << o->name << " to the render workers" << endl;
+		}
+	}
+
+	p.put((int)lights.size());
+	for (size_t l = 0; l < lights.size(); l++)
+		p.put((int)(std::find(scene.begin(), scene.end(), lights[l]) - scene.begin()));
+	return p.data;
+}
+
+
+//  ***
+//  the snapshot sent by serialize(), NULL if data is not one
+//
+shared_ptr<RenderScene> RenderScene::deserialize(const string &data) {
+	shared_ptr<RenderScene> rs(new RenderScene());
+	Unpacker u(data);
+	uint32_t magic = 0;
+
+	u.get(magic);
+	if (magic != sceneMagic) return NULL;
+	u.get(rs->ambientColor);
+	u.get(rs->bkgndColor);
+	u.get(rs->tileSize);
+	u.get(rs->lightCutoff);
+	u.get(rs->lightBudget);
+	u.get(rs->bManyLights);
+	u.get(rs->bPackets);
+	u.get(rs->bAdaptiveShadows);
+	u.get(rs->shadowBatch);
+	u.get(rs->penumbraScale);
+	u.get(rs->samplePattern);
+	u.get(rs->bAntialias);
+	u.get(rs->aaSamples);
+	u.get(rs->aaColor);
+	u.get(rs->aaNormal);
+	u.get(rs->filter);
+	rs->seed = 0;
+	u.get(rs->renderCam.position);
+	u.get(rs->renderCam.aim);
+	u.get(rs->renderCam.view.min);
+	u.get(rs->renderCam.view.max);
+	u.get(rs->renderCam.view.rt);
+	u.get(rs->renderCam.view.position);
+
+	int n = 0;
+	u.get(n);
+	vector<shared_ptr<MeshGeometry>> geometry;
+	for (int g = 0; g < n && u.ok; g++) {
+		MeshBVH::Layout layout = MeshBVH::FULL;
+		vector<glm::vec3> verts;
+		vector<ofIndexType> indices;
+		u.get(layout);
+		u.getArray(verts);
+		u.getArray(indices);
+
+		ofMesh mesh;
+		mesh.addVertices(verts);
+		mesh.addIndices(indices);
+		geometry.push_back(make_shared<MeshGeometry>(mesh, layout));
+	}
+
+	u.get(n);
+	vector<int> parents;
+	for (int i = 0; i < n && u.ok; i++) {
+		char type = 0;
+		int parent = -1;
+		glm::vec3 position, rotation, scale, pivot;
+		ofColor diffuse, specular;
+		bool selectable = true;
+
+		u.get(type);
+		u.get(parent);
+		u.get(position);
+		u.get(rotation);
+		u.get(scale);
+		u.get(pivot);
+		u.get(diffuse);
+		u.get(specular);
+		u.get(selectable);
+
+		//keyframes, up to a frame number of -1
+		//
+		vector<Keyframe *> keys;
+		int k = -1;
+		u.get(k);
+		while (u.ok && k >= 0) {
+			Keyframe *f = new Keyframe(k, 0, glm::vec3(0), glm::vec3(0), glm::vec3(1), glm::vec3(0));
+			u.get(f->function);
+			u.get(f->channels);
+			u.get(f->position);
+			u.get(f->rotation);
+			u.get(f->scale);
+			u.get(f->pivot);
+			keys.push_back(f);
+			k = -1;
+			u.get(k);
+		}
+		if (k != -1) u.ok = false;
+
+		SceneObject *o = NULL;
+		switch (type) {
+		case 'l': {
+			Light *l = new Light(position);
+			u.get(l->radius);
+			u.get(l->intensity);
+			u.get(l->power);
+			u.get(l->angle);
+			u.get(l->N);
+			u.get(l->type);
+			u.get(l->area.min);
+			u.get(l->area.max);
+			u.get(l->area.position);
+			o = l;
+			break;
+		}
+		case 's': {
+			Sphere *sp = new Sphere(position);
+			u.get(sp->radius);
+			o = sp;
+			break;
+		}
+		case 'c': {
+			Cube *c = new Cube(position);
+			u.get(c->width);
+			u.get(c->height);
+			u.get(c->depth);
+			o = c;
+			break;
+		}
+		case 'm': {
+			int g = -1;
+			u.get(g);
+			if (g < 0 || g >= (int)geometry.size()) u.ok = false;
+			else o = new Mesh(geometry[g], position);
+			break;
+		}
+		case 'p': {
+			Plane *pl = new Plane(position);
+			u.get(pl->width);
+			u.get(pl->height);
+			u.get(pl->normal);
+			o = pl;
+			break;
+		}
+		default:
+			u.ok = false;
+		}
+
+		if (!o) {
+			for (size_t f = 0; f < keys.size(); f++) delete keys[f];
+			break;
+		}
+
+		o->rotation = rotation;
+		o->scale = scale;
+		o->pivot = pivot;
+		o->diffuseColor = diffuse;
+		o->specularColor = specular;
+		o->isSelectable = selectable;
+		for (size_t f = 0; f < keys.size(); f++)
+			o->keys.insert(keys[f]);
+		rs->scene.push_back(o);
+		parents.push_back(parent);
+	}
+
+	for (size_t i = 0; i < parents.size(); i++)
+		if (parents[i] >= 0 && parents[i] < (int)rs->scene.size() && parents[i] != (int)i)
+			rs->scene[parents[i]]->addChild(rs->scene[i]);
+
+	u.get(n);
+	for (int l = 0; l < n && u.ok; l++) {
+		int i = -1;
+		u.get(i);
+		if (i < 0 || i >= (int)rs->scene.size() || typeid(*rs->scene[i]) != typeid(Light)) u.ok = false;
+		else rs->lights.push_back((Light *)rs->scene[i]);
+	}
+
+	if (!u.ok || rs->scene.size() != parents.size()) return NULL;
+
+	for (size_t i = 0; i < rs->scene.size(); i++)
+		rs->scene[i]->updateMatrix();
+	for (size_t l = 0; l < rs->lights.size(); l++)
+		rs->lights[l]->area.updateMatrix();
+	rs->buffer.allocate(rs->renderCam.view.width(), rs->renderCam.view.height());
+	return rs;
+}
+
+
+// // // COORDINATOR // // //
+
+
+bool RenderCoordinator::listen(int port) {
+	close();
+	if (!server.setup(port, false)) {
+		std::cout << "cannot listen for render workers on port " << port << endl;
+		return false;
+	}
+	std::cout << "waiting for render workers on port " << port << endl;
+	return true;
+}
+
+
+void RenderCoordinator::close() {
+	cancel();
+	server.close();
+	workers.clear();
+}
+
+
+//  ***
+//  the scene goes to the workers already connected now, and to later ones as they connect
+//
+void RenderCoordinator::start(shared_ptr<RenderScene> scene, int frames, const string &dir) {
+	cancel();
+
+	// a new job id, so images still on their way from the last render are told apart
+	//
+	Packer p;
+	p.put(++job);
+	base = scene;
+	sceneMsg = message(MSG_SCENE, p.data + base->serialize());
+	folder = dir;
+	todo.clear();
+	for (int f = 0; f < frames; f++) todo.push_back(f);
+	done.assign(frames, false);
+	numDone = 0;
+	startTime = ofGetElapsedTimef();
+
+	for (auto it = workers.begin(); it != workers.end(); it++) {
+		server.sendRawBytes(it->first, sceneMsg.data(), sceneMsg.size());
+		it->second.hasScene = true;
+		it->second.lastHeard = startTime;
+	}
+	std::cout << "rendering " << frames << " frames on " << workers.size() << " workers" << endl;
+}
+
+
+void RenderCoordinator::cancel() {
+	if (!base) return;
+
+	for (auto it = workers.begin(); it != workers.end(); it++) {
+		send(it->first, MSG_DONE, "");
+		it->second.frames.clear();
+		it->second.hasScene = false;
+	}
+	base.reset();
+	todo.clear();
+}
+
+
+void RenderCoordinator::send(int id, char type, const string &payload) {
+	string m = message(type, payload);
+	server.sendRawBytes(id, m.data(), m.size());
+}
+
+
+//  ***
+//  accept new workers, read what the workers sent, drop the dead ones and keep
+//  every live worker busy with framesInFlight frames
+//
+bool RenderCoordinator::update() {
+	if (!server.isConnected()) return false;
+
+	float now = ofGetElapsedTimef();
+	int shown = numDone;
+
+	for (int id = 0; id <= server.getLastID(); id++) {
+		if (!server.isClientConnected(id)) {
+			if (workers.count(id)) drop(id, "disconnected");
+			continue;
+		}
+
+		if (!workers.count(id)) {
+			Worker &w = workers[id];
+			w.lastHeard = now;
+			std::cout << "render worker " << id << " connected from " << server.getClientIP(id) << endl;
+			if (base) {
+				server.sendRawBytes(id, sceneMsg.data(), sceneMsg.size());
+				w.hasScene = true;
+			}
+		}
+
+		Worker &w = workers[id];
+		receive(id, w);
+		if (!workers.count(id)) continue;
+
+		if (w.frames.size() && now - w.lastHeard > timeout) {
+			server.disconnectClient(id);
+			drop(id, "timed out");
+		}
+	}
+
+	if (!base) return false;
+	assign();
+
+	if (numDone == (int)done.size()) {
+		std::cout << "Rendering complete! (" << done.size() << " frames, " << ofGetElapsedTimef() - startTime
+			<< " s, " << workers.size() << " workers)" << endl;
+		cancel();
+	}
+	return numDone != shown;
+}
+
+
+void RenderCoordinator::receive(int id, Worker &w) {
+	char buf[65536];
+	int n;
+	while ((n = server.receiveRawBytes(id, buf, sizeof(buf))) > 0)
+		w.in.append(buf, n);
+
+	char type;
+	string payload;
+	bool bad = false;
+	while (nextMessage(w.in, type, payload, bad)) {
+		w.lastHeard = ofGetElapsedTimef();
+		Unpacker u(payload);
+
+		if (type == MSG_HELLO) {
+			u.get(w.threads);
+			std::cout << "render worker " << id << " has " << w.threads << " threads" << endl;
+		}
+		else if (type == MSG_IMAGE && base) {
+			int imageJob = -1, frame = -1, width = 0, height = 0;
+			u.get(imageJob);
+			u.get(frame);
+			u.get(width);
+			u.get(height);
+			if (imageJob != job) continue;
+
+			auto it = std::find(w.frames.begin(), w.frames.end(), frame);
+			if (it == w.frames.end() || payload.size() != 16 + (size_t)width * height * 3) continue;
+			w.frames.erase(it);
+			if (done[frame]) continue;
+
+			newest.setFromPixels((const unsigned char *)payload.data() + 16, width, height, OF_PIXELS_RGB);
+			ofSaveImage(newest, folder + "//frame_" + to_string(frame) + ".png");
+			done[frame] = true;
+			numDone++;
+		}
+	}
+
+	if (bad) {
+		server.disconnectClient(id);
+		drop(id, "sent a corrupt message");
+	}
+}
+
+
+//  ***
+//  frames go out in order, so the images arrive roughly in playback order
+//
+void RenderCoordinator::assign() {
+	for (auto it = workers.begin(); it != workers.end() && todo.size(); it++) {
+		Worker &w = it->second;
+		if (!w.hasScene) continue;
+
+		while ((int)w.frames.size() < framesInFlight && todo.size()) {
+			int frame = todo.front();
+			todo.pop_front();
+			if (done[frame]) continue;
+
+			Packer p;
+			p.put(job);
+			p.put(frame);
+			send(it->first, MSG_FRAME, p.data);
+			if (w.frames.empty()) w.lastHeard = ofGetElapsedTimef();
+			w.frames.push_back(frame);
+		}
+	}
+}
+
+
+//  ***
+//  forget a worker, the frames it had go back to the front of the queue
+//
+void RenderCoordinator::drop(int id, const char *why) {
+	Worker &w = workers[id];
+	for (int i = (int)w.frames.size() - 1; i >= 0; i--)
+		if (base && !done[w.frames[i]]) todo.push_front(w.frames[i]);
+
+	std::cout << "render worker " << id << " " << why;
+	if (base && w.frames.size()) std::cout << ", " << w.frames.size() << " frames reassigned";
+	std::cout << endl;
+	workers.erase(id);
+}
+
+
+// // // WORKER // // //
+
+
+//  ***
+//  connect (again) to the coordinator and render what it sends, never returns
+//  unless the port is invalid
+//
+int RenderWorker::run(const string &host, int port, int threads) {
+	if (port <= 0) {
+		std::cout << "usage: --worker <coordinator host> [port] [threads]" << endl;
+		return 1;
+	}
+	if (threads > 0) pool.resize(threads);
+
+	while (true) {
+		std::cout << "connecting to " << host << ":" << port << endl;
+		while (!client.setup(host, port, false)) ofSleepMillis(1000);
+		std::cout << "connected, " << pool.size() << " render threads" << endl;
+
+		in.clear();
+		dropScene();
+
+		Packer p;
+		p.put(pool.size());
+		send(MSG_HELLO, p.data);
+
+		while (receive()) {
+			if (base && todo.size()) {
+				int frame = todo.front();
+				todo.pop_front();
+				if (!renderFrame(frame)) continue;
+			}
+			else {
+				// the coordinator may have handed out frames already while the scene loads
+				//
+				ofSleepMillis(5);
+				if (loading.valid() && ofGetElapsedTimef() - lastSent > 1) send(MSG_ALIVE, "");
+			}
+		}
+
+		std::cout << "lost the coordinator" << endl;
+		client.close();
+		ofSleepMillis(1000);
+	}
+}
+
+
+void RenderWorker::send(char type, const string &payload) {
+	string m = message(type, payload);
+	client.sendRawBytes(m.data(), m.size());
+	lastSent = ofGetElapsedTimef();
+}
+
+
+bool RenderWorker::receive() {
+	char buf[65536];
+	int n;
+	while ((n = client.receiveRawBytes(buf, sizeof(buf))) > 0)
+		in.append(buf, n);
+	if (!client.isConnected()) return false;
+
+	char type;
+	string payload;
+	bool bad = false;
+	while (nextMessage(in, type, payload, bad)) {
+		Unpacker u(payload);
+
+		if (type == MSG_SCENE) {
+			dropScene();
+			u.get(job);
+			loading = std::async(std::launch::async, [](string data) {
+				return RenderScene::deserialize(data);
+			}, payload.substr(sizeof(job)));
+		}
+		else if (type == MSG_FRAME) {
+			int frameJob = -1, frame = -1;
+			u.get(frameJob);
+			u.get(frame);
+			if (frameJob == job && frame >= 0) todo.push_back(frame);
+		}
+		else if (type == MSG_DONE) {
+			dropScene();
+		}
+	}
+
+	if (loading.valid() && loading.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		base = loading.get();
+		if (!base) std::cout << "could not read the scene" << endl;
+		else std::cout << "scene of " << base->scene.size() << " objects" << endl;
+	}
+	for (size_t i = 0; i < abandoned.size(); )
+		if (abandoned[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready) abandoned.erase(abandoned.begin() + i);
+		else i++;
+
+	return !bad;
+}
+
+
+//  ***
+//  forget the scene and its frames, a scene still being read is left to finish
+//  on its own thread and thrown away then
+//
+void RenderWorker::dropScene() {
+	base.reset();
+	todo.clear();
+	job = -1;
+	if (loading.valid()) abandoned.push_back(std::move(loading));
+}
+
+
+//  ***
+//  the frame renders on the pool while this thread keeps talking to the coordinator,
+//  so a long frame does not look like a dead worker and DONE cancels it
+//  a frame that finishes after its job was cancelled or replaced is not sent
+//
+bool RenderWorker::renderFrame(int frame) {
+	shared_ptr<RenderScene> scene = base;
+	int frameJob = job;
+	RenderScene rs(*scene, frame);
+	std::atomic<bool> cancel(false), finished(false);
+	bool rendered = false;
+
+	std::thread render([&]() {
+		rs.prepare();
+		rendered = rs.renderPass(pool, 1, true, cancel) && (!rs.bAdaptiveShadows || rs.penumbraPass(&pool, cancel)) &&
+				   (!rs.bAntialias || rs.antialiasPass(&pool, cancel));
+		finished = true;
+	});
+
+	bool connected = true;
+	while (!finished) {
+		ofSleepMillis(5);
+		if (connected) connected = receive();
+		if (!connected || base != scene) cancel = true;
+		else if (ofGetElapsedTimef() - lastSent > 1) send(MSG_ALIVE, "");
+	}
+	render.join();
+	if (!rendered || !connected || base != scene) return false;
+
+	ofPixels pixels;
+	rs.fillBlocks(1, pixels);
+
+	Packer p;
+	p.put(frameJob);
+	p.put(frame);
+	p.put((int)pixels.getWidth());
+	p.put((int)pixels.getHeight());
+	p.data.append((const char *)pixels.getData(), pixels.getWidth() * pixels.getHeight() * 3);
+	send(MSG_IMAGE, p.data);
+	std::cout << "frame " << frame << " done" << endl;
+	return true;
+}
@@ -0,0 +1,121 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxNetwork.h"
+#include "renderscene.h"
+#include <deque>
+#include <future>
+
+
+//  ***
+//  Distributed animation rendering
+//  The coordinator (the interactive app) listens for worker processes, sends each of
+//  them the animation's RenderScene snapshot and hands out frames, a couple at a time
+//  per worker, until every frame is back. Workers are the same executable started
+//  with --worker, on this host or any host that can reach the coordinator over TCP.
+//  A worker that disconnects or stops answering has its frames handed to the others.
+//
+//  Messages are a 4 byte length, a 1 byte type and the payload. The scene travels in
+//  the host's byte order, the coordinator and workers are expected to run on the
+//  same architecture.
+//
+class RenderCoordinator {
+public:
+	// // // VARIABLES // // //
+
+	static const int defaultPort = 11999;
+
+	float timeout = 10;				// seconds without a message before a busy worker is dropped
+	int framesInFlight = 2;			// frames handed to a worker before it returns one
+	ofPixels newest;				// last frame that came back
+
+	// // // FUNCTIONS // // //
+
+	bool listen(int port = defaultPort);	// accept workers from now on
+	void close();
+
+	// render frames 0 .. frames-1 of base's keyframes into folder/frame_N.png
+	//
+	void start(shared_ptr<RenderScene> base, int frames, const string &folder);
+	void cancel();
+
+	// poll the workers, call every update(); true when a frame came back (see newest)
+	//
+	bool update();
+
+	bool isListening() { return server.isConnected(); }
+	bool isRendering() const { return base != NULL; }
+	int numWorkers() const { return workers.size(); }
+
+private:
+	// // // VARIABLES // // //
+
+	struct Worker {
+		string in;				// bytes received, not yet a whole message
+		vector<int> frames;		// handed out and not back yet
+		float lastHeard = 0;
+		int threads = 0;
+		bool hasScene = false;
+	};
+
+	ofxTCPServer server;
+	map<int, Worker> workers;	// by server client id
+
+	shared_ptr<RenderScene> base;
+	int job = 0;				// id of the current render, sent with its scene, frames and images
+	string sceneMsg;			// base, serialized once for every worker
+	string folder;
+	deque<int> todo;			// frames not handed out
+	vector<bool> done;
+	int numDone = 0;
+	float startTime = 0;
+
+	// // // FUNCTIONS // // //
+
+	void send(int id, char type, const string &payload);
+	void receive(int id, Worker &w);
+	void assign();
+	void drop(int id, const char *why);
+};
+
+
+//  ***
+//  Worker process: renders the frames a coordinator hands it with a thread pool of its
+//  own and sends the images back; runs until the process is killed, reconnecting
+//  whenever the coordinator goes away (so workers can be started before it)
+//
+class RenderWorker {
+public:
+	int run(const string &host, int port = RenderCoordinator::defaultPort, int threads = 0);
+
+private:
+	// // // VARIABLES // // //
+
+	ofxTCPClient client;
+	ThreadPool pool;
+	string in;
+	shared_ptr<RenderScene> base;
+	int job = -1;						// of base, -1 for none
+	deque<int> todo;
+
+	// the scene is read (and its mesh BVHs built) off the connection's thread, so
+	// heartbeats keep going out meanwhile; base is set once it is ready
+	//
+	std::future<shared_ptr<RenderScene>> loading;
+	vector<std::future<shared_ptr<RenderScene>>> abandoned;	// replaced before they were ready
+	float lastSent = 0;
+
+	// // // FUNCTIONS // // //
+
+	void send(char type, const string &payload);
+	bool receive();						// read what arrived, false if the connection is lost
+	void dropScene();
+	bool renderFrame(int frame);		// false if cancelled or disconnected meanwhile
+};
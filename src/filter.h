@@ -0,0 +1,78 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#pragma once
+
+#include "ofMain.h"
+
+//  ***
+//  Reconstruction filter of the anti-aliased pixels (see RenderScene::antialiasTile)
+//  The subpixel rays of a pixel are spread over the filter's square of radius pixels
+//  around its center and averaged with the weights weight(dx, dy) gives them. Wider
+//  filters are smoother, BOX over half a pixel is plain supersampling; MITCHELL has
+//  small negative lobes that keep the edges sharp.
+//
+class PixelFilter {
+public:
+	enum Type { BOX, TENT, GAUSSIAN, MITCHELL };
+
+	// // // VARIABLES // // //
+
+	Type type = BOX;
+	float radius = 0.5f;	// pixels from the center to the edge of the support
+
+	// // // FUNCTIONS // // //
+
+	// the filter with the radius it is usually given
+	//
+	void setup(Type t) {
+		static const float radii[] = { 0.5f, 1.0f, 1.5f, 2.0f };
+		type = t;
+		radius = radii[t];
+	}
+
+	// separable, dx and dy are pixels from the center
+	//
+	float weight(float dx, float dy) const {
+		return weight1D(fabsf(dx) / radius) * weight1D(fabsf(dy) / radius);
+	}
+
+	const char *name() const {
+		static const char *names[] = { "box", "tent", "gaussian", "mitchell" };
+		return names[type];
+	}
+
+private:
+	// x runs from 0 at the center to 1 at the edge of the support
+	//
+	float weight1D(float x) const {
+		if (x >= 1) return 0;
+
+		switch (type) {
+		case TENT:
+			return 1 - x;
+
+		//alpha = 2 on the radius in pixels, shifted so it reaches 0 at the edge
+		//
+		case GAUSSIAN: {
+			float r = x * radius;
+			return expf(-2 * r * r) - expf(-2 * radius * radius);
+		}
+
+		//Mitchell-Netravali with B = C = 1/3, over -2 .. 2
+		//
+		case MITCHELL: {
+			float t = 2 * x;
+			if (t < 1) return (7 * t * t * t - 12 * t * t + 16.0f / 3) / 6;
+			return (-7.0f / 3 * t * t * t + 12 * t * t - 20 * t + 32.0f / 3) / 6;
+		}
+
+		default:
+			return 1;
+		}
+	}
+};
@@ -0,0 +1,110 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#pragma once
+
+#include "ofMain.h"
+#include <stdint.h>
+
+//  ***
+//  Linear float image the render passes shade into (see RenderScene::buffer)
+//  Colors are unclamped floats in 8-bit units (255 = full), so the lights and area light
+//  samples summed at a pixel and the subpixel rays averaged at an edge keep their
+//  precision and anything brighter than white; tonemap() clamps and quantizes them
+//  into an ofPixels once a pass is done.
+//  The pixels are stored in tiles of TILE x TILE (3 KB of floats), each tile in Morton
+//  order, so the pixels a render tile shades and the 3 x 3 neighbourhoods the passes
+//  read sit in a few cache lines instead of one per image row.
+//  Coordinates are the render's, from 0: x to the right, y up from the bottom row.
+//
+class FrameBuffer {
+public:
+	const static int TILE_BITS = 4, TILE = 1 << TILE_BITS;
+
+	// // // FUNCTIONS // // //
+
+	void allocate(int w, int h) {
+		width = w;
+		height = h;
+		tilesX = (w + TILE - 1) >> TILE_BITS;
+		int tilesY = (h + TILE - 1) >> TILE_BITS;
+		data.assign(size_t(tilesX) * tilesY * TILE * TILE, glm::vec3(0, 0, 0));
+	}
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	glm::vec3 &at(int x, int y) { return data[index(x, y)]; }
+	const glm::vec3 &at(int x, int y) const { return data[index(x, y)]; }
+
+	// where pixel (x, y) is stored, for per pixel arrays of size() laid out like the buffer
+	//
+	size_t index(int x, int y) const {
+		size_t tile = size_t(y >> TILE_BITS) * tilesX + (x >> TILE_BITS);
+		return (tile << (2 * TILE_BITS)) + morton(x & (TILE - 1), y & (TILE - 1));
+	}
+
+	size_t size() const { return data.size(); }		// whole tiles, the edge ones padded
+
+	// the 8-bit image, rows top to bottom like ofApp::image, each channel rounded and
+	// clamped to 0..255; the tiles are read in the order they are stored
+	//
+	void tonemap(ofPixels &out) const {
+		if ((int)out.getWidth() != width || (int)out.getHeight() != height || out.getNumChannels() != 3)
+			out.allocate(width, height, OF_PIXELS_RGB);
+		unsigned char *dst = out.getData();
+
+		for (size_t t = 0; t < data.size(); t += TILE * TILE) {
+			int tile = int(t >> (2 * TILE_BITS));
+			int x0 = (tile % tilesX) << TILE_BITS, y0 = (tile / tilesX) << TILE_BITS;
+
+			for (int m = 0; m < TILE * TILE; m++) {
+				int x = x0 + compact(m), y = y0 + compact(m >> 1);
+				if (x >= width || y >= height) continue;
+
+				glm::vec3 c = glm::clamp(data[t + m] + 0.5f, glm::vec3(0), glm::vec3(255));
+				unsigned char *p = dst + 3 * (size_t(height - 1 - y) * width + x);
+				p[0] = c.x;
+				p[1] = c.y;
+				p[2] = c.z;
+			}
+		}
+	}
+
+	// x and y (16 bits each) with their bits interleaved, x in the even bits
+	//
+	static uint32_t morton(uint32_t x, uint32_t y) {
+		return spread(x) | (spread(y) << 1);
+	}
+
+private:
+	// // // VARIABLES // // //
+
+	int width = 0, height = 0, tilesX = 0;
+	vector<glm::vec3> data;
+
+	// // // FUNCTIONS // // //
+
+	static uint32_t spread(uint32_t v) {
+		v = (v | (v << 8)) & 0x00ff00ffu;
+		v = (v | (v << 4)) & 0x0f0f0f0fu;
+		v = (v | (v << 2)) & 0x33333333u;
+		v = (v | (v << 1)) & 0x55555555u;
+		return v;
+	}
+
+	// the even bits of v packed together, the inverse of spread()
+	//
+	static int compact(uint32_t v) {
+		v &= 0x55555555u;
+		v = (v | (v >> 1)) & 0x33333333u;
+		v = (v | (v >> 2)) & 0x0f0f0f0fu;
+		v = (v | (v >> 4)) & 0x00ff00ffu;
+		v = (v | (v >> 8)) & 0x0000ffffu;
+		return v;
+	}
+};
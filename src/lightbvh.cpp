@@ -0,0 +1,129 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+//
+//  Light hierarchy used by the many-light mode of the renderer
+//  Instead of a shadow ray per light, each shading point draws a fixed number
+//  of lights from the tree and weights their shading by 1 / pdf, which keeps the
+//  expected value equal to the sum over all lights.
+//
+
+#include "Primitives.h"
+
+
+// // // BUILD // // //
+
+
+//  ***
+//  the lights are only referenced, the tree has to be rebuilt when they move
+//
+void LightBVH::build(const vector<Light *> &ls, float cut) {
+	lights = ls;
+	cutoff = cut;
+	nodes.clear();
+	order.resize(lights.size());
+	positions.resize(lights.size());
+
+	for (size_t i = 0; i < lights.size(); i++) {
+		order[i] = i;
+		positions[i] = lights[i]->worldPosition();
+	}
+
+	if (lights.size()) {
+		nodes.reserve(2 * lights.size());
+		buildNode(0, lights.size());
+	}
+}
+
+
+//  ***
+//  median split on the longest axis of the light positions (see SceneBVH::buildNode)
+//
+int LightBVH::buildNode(int start, int end) {
+	int n = nodes.size();
+	nodes.push_back(Node());
+
+	AABB box;
+	float intensity = 0, radius = 0;
+	for (int i = start; i < end; i++) {
+		Light *light = lights[order[i]];
+		box.expand(positions[order[i]]);
+		intensity += std::max(light->intensity, 0.0f);
+		radius = std::max(radius, light->influenceRadius(cutoff));
+	}
+	nodes[n].box = box;
+	nodes[n].intensity = intensity;
+	nodes[n].radius = radius;
+
+	if (end - start == 1) {
+		nodes[n].light = order[start];
+		return n;
+	}
+
+	int axis = box.longestAxis();
+	int mid = (start + end) / 2;
+	std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + end,
+		[&](int a, int b) { return positions[a][axis] < positions[b][axis]; });
+
+	buildNode(start, mid);
+	int right = buildNode(mid, end);
+	nodes[n].right = right;
+	return n;
+}
+
+
+// // // SAMPLING // // //
+
+
+//  ***
+//  estimated contribution of the lights below node at p
+//  0 only when none of them can light p, the same tests as Light::mayLight, so no
+//  light that contributes is ever skipped and the estimate stays unbiased
+//
+float LightBVH::importance(const Node &node, const glm::vec3 &p) const {
+	if (node.intensity <= 0) return 0;
+	if (node.box.distance2(p) > node.radius * node.radius) return 0;
+	if (node.light >= 0 && !lights[node.light]->mayLight(p, cutoff)) return 0;
+
+	// distance to the center, but never closer than the node's half diagonal,
+	// so a large cluster around p is not favoured without bound
+	//
+	glm::vec3 v = p - node.box.center(), e = (node.box.max - node.box.min) * 0.5f;
+	float d2 = std::max(std::max(glm::dot(v, v), glm::dot(e, e)), 1e-6f);
+	return node.intensity / d2;
+}
+
+
+//  ***
+//  one walk from the root, u is rescaled at every level so a single number picks the leaf
+//
+int LightBVH::sample(const glm::vec3 &p, float u, float &pdf) const {
+	pdf = 1;
+	if (nodes.empty() || importance(nodes[0], p) <= 0) return -1;
+
+	int n = 0;
+	while (nodes[n].light < 0) {
+		int left = n + 1, right = nodes[n].right;
+		float wl = importance(nodes[left], p), wr = importance(nodes[right], p);
+		if (wl + wr <= 0) return -1;
+
+		float pl = wl / (wl + wr);
+		if (u < pl) {
+			n = left;
+			pdf *= pl;
+			u = u / pl;
+		}
+		else {
+			n = right;
+			pdf *= 1 - pl;
+			u = (u - pl) / (1 - pl);
+		}
+		u = std::min(u, 0.99999994f);
+	}
+
+	return nodes[n].light;
+}
@@ -1,8 +1,26 @@
 #include "ofMain.h"
 #include "ofApp.h"
+#include "bench.h"
 
 //========================================================================
-int main( ){
+int main(int argc, char *argv[]){
+	// *** render worker for distributed animation renders, no window:
+	//     RayTraceAnimation --worker <coordinator host> [port] [threads]
+	//
+	if (argc > 2 && string(argv[1]) == "--worker") {
+		RenderWorker worker;
+		return worker.run(argv[2], argc > 3 ? ofToInt(argv[3]) : RenderCoordinator::defaultPort,
+						  argc > 4 ? ofToInt(argv[4]) : 0);
+	}
+
+	// *** headless benchmark of the renderer, see bench.h for the settings:
+	//     RayTraceAnimation --bench [setting=value ...]
+	//
+	if (argc > 1 && string(argv[1]) == "--bench") {
+		RenderBench bench;
+		return bench.run(vector<string>(argv + 2, argv + argc));
+	}
+
 	ofSetupOpenGL(1024,768,OF_WINDOW);			// <-------- setup the GL context
 
 	// this kicks off the running of my app
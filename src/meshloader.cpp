@@ -0,0 +1,536 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#include "meshloader.h"
+#include <atomic>
+#include <fstream>
+#include <string.h>
+
+
+// // // PARSING // // //
+
+// chunks are at least this big, smaller files are parsed on fewer threads
+//
+static const size_t minChunkBytes = 1 << 20;
+
+static inline bool blank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool digit(char c) {
+	return unsigned(c - '0') < 10;
+}
+
+static inline const char *skipBlank(const char *p, const char *end) {
+	while (p < end && blank(*p)) p++;
+	return p;
+}
+
+static inline const char *nextLine(const char *p, const char *end) {
+	p = (const char *)memchr(p, '\n', end - p);
+	return p ? p + 1 : end;
+}
+
+//  ***
+//  decimal number at p such as "-1.25e-3", 0 if there is none
+//  The digits are gathered into an integer (the first 19 significant ones, which is
+//  more than a float holds) and scaled once by a power of ten in double precision.
+//  Does not read past the end of the line.
+//
+static const char *parseFloat(const char *p, const char *end, float &f) {
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	p = skipBlank(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+	uint64_t m = 0;
+	int exponent = 0, digits = 0;
+	const char *start = p;
+
+	for (; p < end && digit(*p); p++) {
+		if (digits < 19) {
+			m = m * 10 + (*p - '0');
+			if (m) digits++;
+		}
+		else exponent++;
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && digit(*p); p++) {
+			if (digits < 19) {
+				m = m * 10 + (*p - '0');
+				if (m) digits++;
+				exponent--;
+			}
+		}
+	}
+	if (p == start) {
+		f = 0;
+		return p;
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char *q = p + 1;
+		bool negExp = false;
+		if (q < end && (*q == '-' || *q == '+')) negExp = *q++ == '-';
+		if (q < end && digit(*q)) {
+			int e = 0;
+			for (; q < end && digit(*q); q++)
+				if (e < 10000) e = e * 10 + (*q - '0');
+			exponent += negExp ? -e : e;
+			p = q;
+		}
+	}
+
+	// a zero mantissa stays zero whatever the exponent, 0e400 would scale it by infinity
+	//
+	if (!m) {
+		f = negative ? -0.0f : 0.0f;
+		return p;
+	}
+
+	double v = (double)m;
+	int e = std::abs(exponent);
+	double scale = e <= 22 ? powers[e] : std::pow(10.0, e);
+	v = exponent < 0 ? v / scale : v * scale;
+	f = float(negative ? -v : v);
+	return p;
+}
+
+//  ***
+//  vertex index of an OBJ face corner "v", "v/vt", "v//vn" or "v/vt/vn"
+//  0 when the corner has none, the rest of the corner is skipped
+//
+static const char *parseCorner(const char *p, const char *end, int64_t &index) {
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+	index = 0;
+	for (; p < end && digit(*p); p++)
+		if (index < (int64_t(1) << 40)) index = index * 10 + (*p - '0');
+	if (negative) index = -index;
+
+	while (p < end && !blank(*p) && *p != '\n') p++;
+	return p;
+}
+
+
+// // // LOADER // // //
+
+//  ***
+//  read the file in one go and parse it by its extension
+//
+bool MeshLoader::load(const string &file, ofMesh &mesh) {
+	stat = Stats();
+	message.clear();
+	live = 0;
+	stat.threads = std::max(1u, std::thread::hardware_concurrency());
+
+	string path = ofToDataPath(file);
+	string ext = path.substr(std::min(path.size(), path.find_last_of('.')));
+	for (size_t i = 0; i < ext.size(); i++) ext[i] = tolower(ext[i]);
+	if (ext != ".obj" && ext != ".stl") {
+		message = "not an .obj or .stl file";
+		return false;
+	}
+
+	float start = ofGetElapsedTimef();
+	std::ifstream in(path, std::ios::binary | std::ios::ate);
+	if (!in) {
+		message = "cannot open " + path;
+		return false;
+	}
+	vector<char> data((size_t)in.tellg());
+	in.seekg(0);
+	in.read(data.data(), data.size());
+	if (!in) {
+		message = "cannot read " + path;
+		return false;
+	}
+	stat.fileBytes = data.size();
+	hold(data.size());
+	stat.read = ofGetElapsedTimef() - start;
+
+	vector<glm::vec3> verts;
+	vector<ofIndexType> tri;
+	if (!(ext == ".obj" ? loadOBJ(data, verts, tri) : loadSTL(data, verts, tri))) return false;
+
+	if (tri.empty()) {
+		message = "no triangles in " + path;
+		return false;
+	}
+
+	start = ofGetElapsedTimef();
+	vector<glm::vec3> normals;
+	computeNormals(verts, tri, normals);
+	stat.normals = ofGetElapsedTimef() - start;
+
+	stat.vertices = verts.size();
+	stat.triangles = tri.size() / 3;
+
+	mesh.clear();
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+	mesh.getVertices().swap(verts);
+	mesh.getIndices().swap(tri);
+	mesh.getNormals().swap(normals);
+	return true;
+}
+
+
+//  ***
+//  OBJ: each chunk collects its "v" lines and the triangles of its "f" lines,
+//  then every chunk's arrays are copied into place in parallel
+//
+bool MeshLoader::loadOBJ(vector<char> &data, vector<glm::vec3> &verts, vector<ofIndexType> &tri) {
+	float start = ofGetElapsedTimef();
+	vector<Chunk> chunks = split(data, minChunkBytes);
+
+	parallel(chunks.size(), [&](int i) {
+		Chunk &c = chunks[i];
+		const char *p = c.begin, *end = c.end;
+
+		// corners of the current face, and whether each one is relative
+		//
+		vector<int64_t> face;
+		vector<bool> relative;
+
+		while (p < end) {
+			p = skipBlank(p, end);
+
+			if (end - p > 1 && p[0] == 'v' && blank(p[1])) {
+				glm::vec3 v;
+				p = parseFloat(p + 1, end, v.x);
+				p = parseFloat(p, end, v.y);
+				p = parseFloat(p, end, v.z);
+				c.verts.push_back(v);
+			}
+			else if (end - p > 1 && p[0] == 'f' && blank(p[1])) {
+				face.clear();
+				relative.clear();
+				bool bad = false;
+
+				for (p = skipBlank(p + 1, end); p < end && *p != '\n' && *p != '#'; p = skipBlank(p, end)) {
+					int64_t k;
+					p = parseCorner(p, end, k);
+					if (!k) bad = true;
+					face.push_back(k > 0 ? k - 1 : int64_t(c.verts.size()) + k);
+					relative.push_back(k < 0);
+				}
+
+				if (bad || face.size() < 3) {
+					c.skipped++;
+				}
+				else {
+					// fan around the first corner
+					//
+					for (size_t j = 2; j < face.size(); j++) {
+						size_t corner[3] = { 0, j - 1, j };
+						for (int k = 0; k < 3; k++) {
+							if (relative[corner[k]]) c.relative.push_back(c.tri.size());
+							c.tri.push_back(face[corner[k]]);
+						}
+					}
+				}
+			}
+
+			p = nextLine(p, end);
+		}
+	});
+
+	// where each chunk's vertices and triangles go
+	//
+	vector<size_t> vertBase(chunks.size() + 1, 0), triBase(chunks.size() + 1, 0);
+	size_t chunkBytes = 0;
+	for (size_t i = 0; i < chunks.size(); i++) {
+		vertBase[i + 1] = vertBase[i] + chunks[i].verts.size();
+		triBase[i + 1] = triBase[i] + chunks[i].tri.size();
+		chunkBytes += chunks[i].verts.capacity() * sizeof(glm::vec3) + chunks[i].tri.capacity() * sizeof(int64_t)
+			+ chunks[i].relative.capacity() * sizeof(size_t);
+		stat.skipped += chunks[i].skipped;
+	}
+	hold(chunkBytes);
+	release(data.size());
+	vector<char>().swap(data);
+
+	size_t numVerts = vertBase.back();
+	if (numVerts >= std::numeric_limits<ofIndexType>::max()) {
+		message = "too many vertices";
+		return false;
+	}
+
+	verts.resize(numVerts);
+	tri.resize(triBase.back());
+	hold(verts.size() * sizeof(glm::vec3) + tri.size() * sizeof(ofIndexType));
+
+	// triangles with an index out of range are marked by their first index and removed below
+	//
+	const ofIndexType invalid = std::numeric_limits<ofIndexType>::max();
+	std::atomic<int> invalidTris(0);
+
+	parallel(chunks.size(), [&](int i) {
+		Chunk &c = chunks[i];
+		std::copy(c.verts.begin(), c.verts.end(), verts.begin() + vertBase[i]);
+
+		ofIndexType *out = tri.data() + triBase[i];
+		size_t r = 0;
+		int bad = 0;
+		for (size_t j = 0; j < c.tri.size(); j += 3) {
+			bool valid = true;
+			for (size_t k = j; k < j + 3; k++) {
+				int64_t v = c.tri[k];
+				if (r < c.relative.size() && c.relative[r] == k) {
+					v += vertBase[i];
+					r++;
+				}
+				valid &= v >= 0 && v < (int64_t)numVerts;
+				out[k] = valid ? ofIndexType(v) : invalid;
+			}
+			if (!valid) {
+				out[j] = invalid;
+				bad++;
+			}
+		}
+		invalidTris += bad;
+
+		vector<glm::vec3>().swap(c.verts);
+		vector<int64_t>().swap(c.tri);
+		vector<size_t>().swap(c.relative);
+	});
+	release(chunkBytes);
+
+	if (invalidTris) {
+		size_t n = 0;
+		for (size_t j = 0; j < tri.size(); j += 3) {
+			if (tri[j] == invalid) continue;
+			for (int k = 0; k < 3; k++) tri[n + k] = tri[j + k];
+			n += 3;
+		}
+		tri.resize(n);
+		stat.skipped += invalidTris;
+	}
+	stat.parse = ofGetElapsedTimef() - start;
+
+	// exporters often repeat positions (the shared corners of separate groups), so
+	// the "v" lines are welded like STL corners and the faces remapped onto them
+	//
+	start = ofGetElapsedTimef();
+	vector<glm::vec3> points;
+	vector<ofIndexType> remap;
+	points.swap(verts);
+	weld(points, verts, remap);
+
+	size_t slice = std::max(size_t(3 << 14), tri.size() / (4 * stat.threads) / 3 * 3);
+	parallel((tri.size() + slice - 1) / slice, [&](int i) {
+		size_t end = std::min(tri.size(), (i + 1) * slice);
+		for (size_t j = i * slice; j < end; j++) tri[j] = remap[tri[j]];
+	});
+	release(remap.size() * sizeof(ofIndexType));
+	stat.weld = ofGetElapsedTimef() - start;
+	return true;
+}
+
+
+//  ***
+//  STL: binary files are a header, a facet count and 50 byte facets, ASCII ones start
+//  with "solid" and list each corner on a "vertex" line. Either way the corners are
+//  gathered in order (three per facet) and then welded.
+//  A binary file whose header happens to start with "solid" is recognized by its size.
+//
+bool MeshLoader::loadSTL(vector<char> &data, vector<glm::vec3> &verts, vector<ofIndexType> &tri) {
+	float start = ofGetElapsedTimef();
+	vector<glm::vec3> corners;
+
+	uint32_t count = 0;
+	if (data.size() >= 84) memcpy(&count, data.data() + 80, 4);
+	bool exact = data.size() >= 84 && data.size() == 84 + 50 * size_t(count);
+	const char *text = skipBlank(data.data(), data.data() + data.size());
+	bool ascii = !exact && data.data() + data.size() - text >= 5 && !strncmp(text, "solid", 5);
+
+	if (!ascii) {
+		if (data.size() < 84) {
+			message = "not an STL file";
+			return false;
+		}
+
+		// facets past the end of a truncated file are dropped
+		//
+		count = std::min(size_t(count), (data.size() - 84) / 50);
+		corners.resize(3 * size_t(count));
+		hold(corners.size() * sizeof(glm::vec3));
+
+		// each facet is a normal, three corners and an attribute word; the corners
+		// are copied as they are (little endian floats)
+		//
+		const size_t facetsPerBlock = minChunkBytes / 50;
+		int blocks = (count + facetsPerBlock - 1) / facetsPerBlock;
+		parallel(blocks, [&](int b) {
+			size_t end = std::min(size_t(count), (b + 1) * facetsPerBlock);
+			for (size_t f = b * facetsPerBlock; f < end; f++)
+				memcpy(&corners[3 * f], data.data() + 84 + 50 * f + 12, 3 * sizeof(glm::vec3));
+		});
+	}
+	else {
+		vector<Chunk> chunks = split(data, minChunkBytes);
+
+		parallel(chunks.size(), [&](int i) {
+			Chunk &c = chunks[i];
+			const char *p = c.begin, *end = c.end;
+			while (p < end) {
+				p = skipBlank(p, end);
+				if (end - p > 6 && !strncmp(p, "vertex", 6) && blank(p[6])) {
+					glm::vec3 v;
+					p = parseFloat(p + 6, end, v.x);
+					p = parseFloat(p, end, v.y);
+					p = parseFloat(p, end, v.z);
+					c.verts.push_back(v);
+				}
+				p = nextLine(p, end);
+			}
+		});
+
+		vector<size_t> base(chunks.size() + 1, 0);
+		size_t chunkBytes = 0;
+		for (size_t i = 0; i < chunks.size(); i++) {
+			base[i + 1] = base[i] + chunks[i].verts.size();
+			chunkBytes += chunks[i].verts.capacity() * sizeof(glm::vec3);
+		}
+		hold(chunkBytes);
+
+		corners.resize(base.back() - base.back() % 3);
+		hold(corners.size() * sizeof(glm::vec3));
+		parallel(chunks.size(), [&](int i) {
+			vector<glm::vec3> &v = chunks[i].verts;
+			size_t n = std::min(v.size(), corners.size() - std::min(corners.size(), base[i]));
+			std::copy(v.begin(), v.begin() + n, corners.begin() + base[i]);
+			vector<glm::vec3>().swap(v);
+		});
+		release(chunkBytes);
+	}
+
+	release(data.size());
+	vector<char>().swap(data);
+	stat.parse = ofGetElapsedTimef() - start;
+
+	if (corners.size() >= std::numeric_limits<ofIndexType>::max()) {
+		message = "too many triangles";
+		return false;
+	}
+
+	start = ofGetElapsedTimef();
+	weld(corners, verts, tri);
+	stat.weld = ofGetElapsedTimef() - start;
+	return true;
+}
+
+
+//  ***
+//  corners at exactly the same position become one vertex (-0 and 0 are the same),
+//  tri[i] is the vertex of corners[i]. The table maps a position's hash to its vertex, probed linearly and kept at most
+//  half full. The corners are freed once they are indexed.
+//
+void MeshLoader::weld(vector<glm::vec3> &corners, vector<glm::vec3> &verts, vector<ofIndexType> &tri) {
+	const uint32_t empty = std::numeric_limits<uint32_t>::max();
+	size_t size = 16;
+	while (size < 2 * corners.size()) size <<= 1;
+
+	vector<uint32_t> table(size, empty);
+	tri.resize(corners.size());
+	verts.clear();
+	verts.reserve(corners.size() / 5 + 16);		// a closed mesh has about half as many vertices as triangles
+	hold(table.size() * sizeof(uint32_t) + tri.size() * sizeof(ofIndexType));
+
+	for (size_t i = 0; i < corners.size(); i++) {
+		glm::vec3 v = corners[i] + glm::vec3(0);
+		uint32_t bits[3];
+		memcpy(bits, &v, sizeof(bits));
+
+		uint64_t h = bits[0] * 0x9E3779B97F4A7C15ull ^ bits[1] * 0xC2B2AE3D27D4EB4Full ^ bits[2] * 0x165667B19E3779F9ull;
+		h ^= h >> 32;
+
+		for (h &= size - 1; ; h = (h + 1) & (size - 1)) {
+			uint32_t s = table[h];
+			if (s == empty) {
+				table[h] = verts.size();
+				tri[i] = verts.size();
+				verts.push_back(v);
+				break;
+			}
+			if (!memcmp(&verts[s], &v, sizeof(v))) {
+				tri[i] = s;
+				break;
+			}
+		}
+	}
+	hold(verts.capacity() * sizeof(glm::vec3));
+
+	release(table.size() * sizeof(uint32_t) + corners.size() * sizeof(glm::vec3));
+	vector<uint32_t>().swap(table);
+	vector<glm::vec3>().swap(corners);
+	verts.shrink_to_fit();
+}
+
+
+//  ***
+//  area weighted average of the normals of the faces around each vertex
+//
+void MeshLoader::computeNormals(const vector<glm::vec3> &verts, const vector<ofIndexType> &tri, vector<glm::vec3> &normals) {
+	normals.assign(verts.size(), glm::vec3(0));
+	hold(normals.size() * sizeof(glm::vec3));
+
+	for (size_t i = 0; i + 2 < tri.size(); i += 3) {
+		const glm::vec3 &a = verts[tri[i]], &b = verts[tri[i + 1]], &c = verts[tri[i + 2]];
+		glm::vec3 n = glm::cross(b - a, c - a);
+		for (int k = 0; k < 3; k++) normals[tri[i + k]] += n;
+	}
+
+	const size_t perBlock = 1 << 16;
+	parallel((normals.size() + perBlock - 1) / perBlock, [&](int b) {
+		size_t end = std::min(normals.size(), (b + 1) * perBlock);
+		for (size_t i = b * perBlock; i < end; i++) {
+			float len = glm::length(normals[i]);
+			normals[i] = len > 0 ? normals[i] / len : glm::vec3(0, 0, 1);
+		}
+	});
+}
+
+
+//  ***
+//  cut data into about 4 chunks per thread, each ending after a newline
+//
+vector<MeshLoader::Chunk> MeshLoader::split(const vector<char> &data, size_t minBytes) {
+	const char *begin = data.data(), *end = begin + data.size();
+	size_t n = std::max(size_t(1), std::min(size_t(4 * stat.threads), data.size() / minBytes));
+
+	vector<Chunk> chunks(n);
+	const char *p = begin;
+	for (size_t i = 0; i < n; i++) {
+		const char *q = end;
+		if (i + 1 < n) q = nextLine(std::max(p, begin + data.size() / n * (i + 1)), end);
+		chunks[i].begin = p;
+		chunks[i].end = q;
+		p = q;
+	}
+	return chunks;
+}
+
+
+//  ***
+//  run f(0) ... f(count - 1) on up to stat.threads threads, this one included
+//  (the render's pool is not used: a model can be dropped in while it renders)
+//
+void MeshLoader::parallel(int count, const std::function<void(int)> &f) {
+	std::atomic<int> next(0);
+	auto work = [&]() {
+		for (int i; (i = next++) < count; ) f(i);
+	};
+
+	vector<std::thread> workers;
+	for (int t = 1; t < std::min(count, stat.threads); t++) workers.emplace_back(work);
+	work();
+	for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+}
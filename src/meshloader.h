@@ -0,0 +1,84 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#pragma once
+
+#include "ofMain.h"
+#include <stdint.h>
+
+//  ***
+//  Reads OBJ and STL (binary or ASCII) models straight into the welded, indexed
+//  triangle list MeshBVH builds from, with no importer library in between
+//  The file is read whole and cut into chunks at line (or facet) boundaries, each
+//  chunk is parsed on its own thread into its own vertex and index arrays, and the
+//  chunks are then copied into place at offsets found by a prefix sum. Only positions
+//  are read: OBJ polygons become triangle fans, texture coordinates, normals, groups
+//  and materials are skipped, and a model is always one mesh. The corners of STL
+//  facets, and the vertices of OBJ files, are welded through a hash table on their
+//  positions. Smooth vertex normals are computed from the faces for drawing.
+//  The result is swapped into the caller's ofMesh, nothing is copied out of the loader.
+//
+class MeshLoader {
+public:
+	// // // VARIABLES // // //
+
+	// what the last load() took, times in seconds
+	//
+	struct Stats {
+		float read = 0, parse = 0, weld = 0, normals = 0;
+		int threads = 0;
+		size_t fileBytes = 0;
+		size_t peakBytes = 0;		// most the loader held at once: file, chunks and result
+		int triangles = 0, vertices = 0;
+		int skipped = 0;			// faces left out, with too few corners or an index out of range
+	};
+
+	// // // FUNCTIONS // // //
+
+	// load an .obj or .stl file (by extension, relative to the data folder) into mesh
+	// false if the file cannot be read or is not a model, see error()
+	//
+	bool load(const string &file, ofMesh &mesh);
+
+	const Stats &stats() const { return stat; }
+	const string &error() const { return message; }
+
+private:
+	// // // VARIABLES // // //
+
+	// a part of the file and what its thread parsed
+	// OBJ indices are relative to the chunk: a positive index is already final,
+	// a negative one counts back from the chunk's own vertices and is listed in
+	// relative, to have the number of vertices before the chunk added once it is known
+	//
+	struct Chunk {
+		const char *begin, *end;
+		vector<glm::vec3> verts;
+		vector<int64_t> tri;
+		vector<size_t> relative;	// positions in tri
+		int skipped = 0;
+	};
+
+	Stats stat;
+	string message;
+	size_t live = 0;				// bytes held now, for stat.peakBytes
+
+	// // // FUNCTIONS // // //
+
+	// parse the file in data (freed once it is no longer needed) into an indexed triangle list
+	//
+	bool loadOBJ(vector<char> &data, vector<glm::vec3> &verts, vector<ofIndexType> &tri);
+	bool loadSTL(vector<char> &data, vector<glm::vec3> &verts, vector<ofIndexType> &tri);
+	void weld(vector<glm::vec3> &corners, vector<glm::vec3> &verts, vector<ofIndexType> &tri);
+	void computeNormals(const vector<glm::vec3> &verts, const vector<ofIndexType> &tri, vector<glm::vec3> &normals);
+
+	vector<Chunk> split(const vector<char> &data, size_t minBytes);
+	void parallel(int count, const std::function<void(int)> &f);
+
+	void hold(size_t bytes) { live += bytes; stat.peakBytes = std::max(stat.peakBytes, live); }
+	void release(size_t bytes) { live -= std::min(live, bytes); }
+};
@@ -13,10 +13,7 @@ void ofApp::setup(){
 	//
 	scene.push_back(new Plane(glm::vec3(0, -2, 0)));
 	scene[0]->name = "Plane0";
-	scene[0]->frmExist[0] = true;
-	scene[0]->frames[0] = new Keyframe(0, 0, glm::vec3(0, -2, 0), glm::vec3(0), glm::vec3(1), glm::vec3(0));
-	recentKF.push_back(0);
-	nextKF.push_back(0);
+	scene[0]->keys.insert(new Keyframe(0, 0, glm::vec3(0, -2, 0), glm::vec3(0), glm::vec3(1), glm::vec3(0)));
 
 	// initialize pixel size of renderCam and image
 	//
@@ -87,11 +84,25 @@ void ofApp::setup(){
 //  update scene channels and sliders
 //
 void ofApp::update(){
+	// *** show the background render's newest pass
+	//
+	pollRender();
+	if (coordinator.update()) image.setFromPixels(coordinator.newest);
+
 	// playback on, aniamte scene
 	//
 	if (bAnimate && bPlayback) { 
-		if (bPlayRT) raytrace();
-		advanceFrame();
+		if (bPlayRT) {
+			if (renderThread.joinable()) return;	// *** the frame's render is not done
+
+			// *** evaluate the frame before rendering it, seeded with its number like
+			//     startAnimationRender's frames so both give the same images
+			//
+			int frame = frmCnt;
+			advanceFrame();
+			startRender(false, true, frame);
+		}
+		else advanceFrame();
 	}
 	// playback off, adjust scene & guis
 	//
@@ -108,19 +119,19 @@ void ofApp::update(){
 		// update selected object
 		//
 		if (objSelected())
-			if (prevSelected != selected[0]) updateSliders();
+			if (prevSelected != selected[0]->handle) updateSliders();
 			else updateSelected(newFrm);
 		
 		// nothing selected, update background & set to defaults
 		//
 		else {
-			if(prevSelected==NULL){
+			if(!prevSelected.valid()){
 				if (rSld != bkgndColor.r)		bkgndColor.r = rSld;
 				else if (gSld != bkgndColor.g)	bkgndColor.g = gSld;
 				else if (bSld != bkgndColor.r)	bkgndColor.b = bSld;
 				ofSetBackgroundColor(bkgndColor);
 			}else{
-				prevSelected = NULL;
+				prevSelected = Handle();
 				rSld = bkgndColor.r;
 				gSld = bkgndColor.g;
 				bSld = bkgndColor.b;
@@ -131,10 +142,24 @@ void ofApp::update(){
 				fnSld = -1; 
 			}
 		}
+
+		// *** the scene was edited while rendering (or in live mode): restart the stale render
+		//
+		if (!renderFrames && (renderThread.joinable() || bLive) && sceneSignature() != renderSignature)
+			startRender(true, renderThread.joinable() && !renderFile.empty());
 	}
 }
 
 
+//  ***
+//  stop the render thread before the scene is deleted
+//
+void ofApp::exit() {
+	cancelRender();
+	coordinator.close();
+}
+
+
 //  ***
 //  draw all elements of the 3D space
 //
@@ -194,11 +219,22 @@ void ofApp::draw(){
 			"MAIN FUNCTIONS:\n"
 			"ALT = enable object selection\n"
 			"A   = enable animation interface\n"
-			"B   = playback\n"
+			"P   = playback (animation interface on)\n"
 			"R   = ray trace\n"
 			"to render animation, press R when playback is on\n"
 			"O   = print channels of selected object\n"
-			"if no object is selected, all objects\' channels printed\n\n"
+			"if no object is selected, all objects\' channels printed\n"
+			"and the memory the objects and keyframes take\n"
+			"C   = cycle mesh layout (full / compact / compact 16 bit)\n"
+			"m   = toggle many-light sampling (not SHIFT, see SHIFT + M)\n"
+			"V   = live render (restart on every scene change)\n"
+			"U   = switch sample pattern (sobol / blue noise)\n"
+			"E   = toggle adaptive area light sampling\n"
+			"SHIFT + A = toggle anti-aliasing\n"
+			"SHIFT + G = switch anti-aliasing filter (box / tent / gaussian / mitchell)\n"
+			"SHIFT + F = render animation frames in parallel\n"
+			"SHIFT + N = render animation frames on worker processes\n"
+			"start workers with: RayTraceAnimation --worker <host> [port] [threads]\n\n"
 			"SCENE OBJECTS:\n"
 			"SHIFT + B = create block\n"
 			"SHIFT + S = create sphere\n"
@@ -275,7 +311,6 @@ void ofApp::keyPressed(int key) {
 			if (bPlayback) {
 				ofSetFrameRate(24);
 				frmCnt = 0;
-				for (int i = 0; i < nextKF.size(); i++) nextKF[i] = 0;
 				std::cout << "Animation playback ON" << endl;
 			}
 			else {
@@ -290,38 +325,110 @@ void ofApp::keyPressed(int key) {
 	case 'r':
 		std::cout << "Rendering start!" << endl;
 		if (!bPlayback) {
-			raytrace();
-			std::cout << "Rendering complete!" << endl;
+			startRender(true, true);	// *** in the background, see pollRender
 		}
 		else {
+			// *** all frames on the render workers, R again cancels
+			//
+			if (bDistributed) {
+				if (coordinator.isRendering()) coordinator.cancel();
+				else startDistributedRender();
+				break;
+			}
+
+			// *** all frames at once from keyframe snapshots, R again cancels
+			//
+			if (bFrameParallel) {
+				if (renderFrames) cancelRender();
+				else startAnimationRender();
+				break;
+			}
+
 			if (!bPlayRT) {
 				frmCnt = frmSld = currFrm = 0;
 				updateFrame();
-				
-				boost::filesystem::path fp = boost::filesystem::current_path();
-				string folder = fp.string();
-				folder += "//data//Animation";
-				string tempFolder = folder + "_0";
-				string p(tempFolder);
-
-				int i = 0;
-				while (boost::filesystem::exists(p) && i < 50) {
-					stringstream s;
-					s << folder << "_" << ++i;
-					p = s.str();
-				}
-				foldCnt = i;
+				newAnimationFolder();		// *** sets foldCnt, the frames are saved there
 			}
 			bPlayRT = !bPlayRT;
 		}	
 		break;
 
+	// *** toggle distributed animation rendering: listen for render workers
+	//
+	case 'N':
+		bDistributed = !bDistributed;
+		if (bDistributed) bDistributed = coordinator.listen();
+		else coordinator.close();
+		break;
+
+	// *** toggle frame-parallel animation rendering
+	//
+	case 'F':
+		bFrameParallel = !bFrameParallel;
+		std::cout << "frame-parallel animation render " << (bFrameParallel ? "on" : "off") << endl;
+		break;
+
 	// print channels for selected object
 	// if none selected print for all objects
 	//
 	case 'o':
 		if (objSelected()) printChannels(selected[0]);
-		else for (int i = 0; i < scene.size(); i++)	printChannels(scene[i]);
+		else {
+			for (int i = 0; i < scene.size(); i++) printChannels(scene[i]);
+
+			// *** pool usage, blocks of deleted objects and keys are reused
+			//
+			std::cout << "objects: " << SceneObject::pool().bytesInUse() / 1024.0 << " of "
+					  << SceneObject::pool().bytesReserved() / 1024.0 << " KB, keyframes: "
+					  << Keyframe::pool().bytesInUse() / 1024.0 << " of "
+					  << Keyframe::pool().bytesReserved() / 1024.0 << " KB" << endl;
+		}
+		break;
+
+	// *** cycle the mesh layout (full / compact / compact 16 bit)
+	//
+	case 'c': setMeshLayout(MeshBVH::Layout((meshLayout + 1) % 3)); break;
+
+	// *** toggle many-light sampling
+	//
+	case 'm':
+		bManyLights = !bManyLights;
+		std::cout << "many-light sampling " << (bManyLights ? "on" : "off") << " (" << lightBudget << " lights per point)" << endl;
+		break;
+
+	// *** toggle adaptive area light sampling
+	//
+	case 'e':
+		bAdaptiveShadows = !bAdaptiveShadows;
+		std::cout << "adaptive area light sampling " << (bAdaptiveShadows ? "on" : "off") << endl;
+		break;
+
+	// *** toggle anti-aliasing
+	//
+	case 'A':
+		bAntialias = !bAntialias;
+		std::cout << "anti-aliasing " << (bAntialias ? "on" : "off") << " (" << aaSamples << " subpixel rays)" << endl;
+		break;
+
+	// *** switch the reconstruction filter, with its usual radius
+	//
+	case 'G':
+		filter.setup(PixelFilter::Type((filter.type + 1) % 4));
+		std::cout << filter.name() << " filter, radius " << filter.radius << endl;
+		break;
+
+	// *** switch the sample pattern
+	//
+	case 'u':
+		samplePattern = Sampler::Pattern((samplePattern + 1) % 2);
+		std::cout << "sample pattern: " << (samplePattern == Sampler::SOBOL ? "sobol" : "blue noise") << endl;
+		break;
+
+	// *** toggle live rendering
+	//
+	case 'v':
+		bLive = !bLive;
+		std::cout << "live render " << (bLive ? "on" : "off") << endl;
 		break;
 
 	// lock selected object, so that it cannot be transformed
@@ -445,34 +552,21 @@ void ofApp::mousePressed(int x, int y, int button) {
 	selected.clear();
 
 	// test if something selected
-	vector<SceneObject *> hits;
-
 	glm::vec3 p = theCam->screenToWorld(glm::vec3(x, y, 0));
 	glm::vec3 d = p - theCam->getPosition();
 	glm::vec3 dn = glm::normalize(d);
 
-	// check for selection of scene objects
-	for (int i = 0; i < scene.size(); i++) {
-		glm::vec3 point, norm;
+	// ***
+	// check for selection of scene objects through the scene BVH, lights included
+	// the nearest hit is selected
+	SceneObject *selectedObj = NULL;
+	glm::vec3 point, norm;
+	int obj;
 
-		//  We hit an object
-		if (scene[i]->isSelectable && scene[i]->intersect(Ray(p, dn), point, norm, renderCam.position))
-			hits.push_back(scene[i]);
-	}
+	sceneBVH.update(scene.items());
+	if (sceneBVH.intersect(Ray(p, dn), point, norm, obj, renderCam.position, true) && scene[obj]->isSelectable)
+		selectedObj = scene[obj];
 
-	// if we selected more than one, pick nearest
-	SceneObject *selectedObj = NULL;
-	if (hits.size() > 0) {
-		selectedObj = hits[0];
-		float nearestDist = numeric_limits<float>::infinity();
-		for (int n = 0; n < hits.size(); n++) {
-			float dist = glm::length(hits[n]->position - theCam->getPosition());
-			if (dist < nearestDist) {
-				nearestDist = dist;
-				selectedObj = hits[n];
-			}
-		}
-	}
 	if (selectedObj) {
 		selected.push_back(selectedObj);
 		bDrag = true;
@@ -492,9 +586,9 @@ void ofApp::dragEvent(ofDragInfo dragInfo) {
 	//
 	boost::filesystem::path path(dragInfo.files[0]);
 
-	// check path.extension() if extension accepted
+	// check path.extension() if extension accepted, in any case
 	//
-	string ext = path.extension().string();
+	string ext = ofToLower(path.extension().string());
 	glm::vec3 p;
 	SceneObject *o;
 	mouseToDragPlane(ofGetMouseX(), ofGetMouseY(), p);
@@ -502,22 +596,23 @@ void ofApp::dragEvent(ofDragInfo dragInfo) {
 	// load object
 	//
 	if (ext == ".obj" || ext == ".stl") {
-		model.loadModel(dragInfo.files[0]); 
+		vector<shared_ptr<MeshGeometry>> &meshes = loadGeometry(dragInfo.files[0]);
+		if (meshes.empty()) {
+			cout << "ERROR: " << path.filename() << " could not be loaded." << endl;
+			return;
+		}
 
-		for (int i = 0; i < model.getNumMeshes(); i++) {
-			o = new Mesh(model.getMesh(i), p);
+		for (size_t i = 0; i < meshes.size(); i++) {
+			o = new Mesh(meshes[i], p);
 			o->name = "Mesh" + to_string(numObj);
-			o->frames[0] = new Keyframe(0, 0, p, glm::vec3(0), glm::vec3(1), glm::vec3(0));
-			o->frmExist[0] = true;
+			o->keys.insert(new Keyframe(0, 0, p, glm::vec3(0), glm::vec3(1), glm::vec3(0)));
 
 			if (objSelected()) {
-				o->position = glm::inverse(selected[0]->getMatrix()) * glm::vec4(p, 1);
+				o->position = selected[0]->getInverseMatrix() * glm::vec4(p, 1);
 				selected[0]->addChild(o);
 			}
 
 			scene.push_back(o);
-			recentKF.push_back(0);
-			nextKF.push_back(0);
 			numObj++;
 		}
 
@@ -28,8 +28,12 @@
 
 #include "ofMain.h"
 #include "ofxGui.h"
-#include "ofxAssimpModelLoader.h"
 #include "Primitives.h"
+#include "meshloader.h"
+#include "renderscene.h"
+#include "distributed.h"
+#include <thread>
+#include <mutex>
 
 class ofApp : public ofBaseApp{
 
@@ -66,12 +70,23 @@ class ofApp : public ofBaseApp{
 		// // // RAYTRACING FUNCTIONS // // //
 		// ***
 		// defined in raytrace.cpp
-		//
-		void raytrace();
-		ofColor lambert(const glm::vec3 &p, const glm::vec3 &norm, 
-						int i, const ofColor diffuse);
-		ofColor phong(const glm::vec3 &v, const glm::vec3 &norm, 
-						int i,	const ofColor diffuse, const ofColor specular);
+		// renders run on renderThread against a RenderScene snapshot, so the scene
+		// can be edited meanwhile; pollRender (called by update) shows their passes
+		//
+		void raytrace();							// render and save, blocks until done
+		void startRender(bool progressive, bool save, uint32_t seed = 0);
+		void cancelRender();
+		void pollRender(bool wait = false);
+		void renderLoop(shared_ptr<RenderScene> rs, int firstStep);
+		void startAnimationRender();				// every frame, several at a time
+		void animationLoop(shared_ptr<RenderScene> base, string folder);
+		void startDistributedRender();				// every frame, on the render workers
+		string nextRenderFile();
+		int nextAnimationFolder();
+		string newAnimationFolder();
+		int animationLength();
+		size_t sceneSignature();
+		void exit();
 
 
 		// // // ANIMATION FUNCTIONS // // //
@@ -82,7 +97,6 @@ class ofApp : public ofBaseApp{
 		void delKeyframe();
 		void updateFrame();
 		void advanceFrame();
-		void calcFrame(int i, int frame);
 		
 
 		// // // SCENE FUNCTIONS // // //
@@ -91,6 +105,8 @@ class ofApp : public ofBaseApp{
 		//
 		void delObj();						// delete selected object
 		void newObj(char key);				// create new primitive object
+		vector<shared_ptr<MeshGeometry>> &loadGeometry(const string &file);	// load a model file once
+		void setMeshLayout(MeshBVH::Layout layout);		// rebuild all mesh geometry in this layout
 		void setFrmSldColor(bool exists);	// set color of frame slider
 		void updateSliders();				// update slider values
 		void updateSelected(bool newFrm);	// update selected object's values
@@ -120,12 +136,14 @@ class ofApp : public ofBaseApp{
 
 		// scene components
 		//
-		vector<SceneObject *> scene;
+		SlotMap<SceneObject, &SceneObject::handle> scene;	// *** unordered, scene[0] is the plane
 		vector<SceneObject *> selected;
-		SceneObject *prevSelected = NULL;
+		Handle prevSelected;		// *** to track if selection changes, null if nothing was selected
 		glm::vec3 lastPoint;
-		vector<Light*> lights;		// ***		
-		ofxAssimpModelLoader model; // ***		
+		SlotMap<Light, &Light::lightHandle> lights;		// ***		
+		SceneBVH sceneBVH;			// ***
+		map<string, vector<shared_ptr<MeshGeometry>>> geometry;	// *** meshes per loaded file, shared by their instances
+		MeshBVH::Layout meshLayout = MeshBVH::FULL;				// *** layout used for new mesh geometry
 
 		// set up one render camera to render image through
 		//
@@ -141,14 +159,41 @@ class ofApp : public ofBaseApp{
 		float imgW, imgH;
 		ofColor ambientColor = ofColor(100, 100, 100);
 		ofColor bkgndColor = ofColor::black;
+		int tileSize = 16;					// *** pixels per side of a light culling tile (multiple of PACKET_W, PACKET_H)
+		float lightCutoff = 1.0 / 255;		// *** intensity / r^2 below this cannot change an 8 bit color
+		int lightBudget = 8;				// *** lights sampled per shading point in many-light mode
+		Sampler::Pattern samplePattern = Sampler::SOBOL;	// *** area light and light selection samples
+		int shadowBatch = 4;				// *** area light points tried besides its corners before deciding if a point is in a penumbra
+		float penumbraScale = 1;			// *** penumbra points get N * penumbraScale shadow rays
+		int aaSamples = 8;					// *** subpixel rays of a pixel on an edge
+		float aaColor = 32;					// *** color difference (in any channel) to a neighbour that makes an edge
+		float aaNormal = 0.9f;				// *** cosine of the angle between neighbours' normals that makes an edge
+		PixelFilter filter;					// *** reconstruction filter of the anti-aliased pixels
+		int progressiveStep = 8;			// *** pixels per side of the blocks of the first progressive pass
+		RenderScene::Stats stats;			// *** cache hit counters of the last render
+		ThreadPool pool;					// *** render threads, one per hardware thread
+
+		// *** background render
+		//
+		std::thread renderThread;
+		std::atomic<bool> renderCancel{ false };
+		std::mutex renderLock;				// guards preview, renderPasses and renderDone
+		ofPixels preview;					// newest finished pass
+		int renderPasses = 0, shownPasses = 0;
+		bool renderDone = false;
+		shared_ptr<RenderScene> renderScene;
+		string renderFile;					// where the render is saved, empty to only show it
+		int renderFrames = 0;				// frames of the animation render in progress
+		RenderCoordinator coordinator;		// *** hands animation frames to worker processes
+		size_t renderSignature = 0;			// sceneSignature() when the render started
+		float renderStart;
 
 		// for animation
 		//
 		int numObj = 1;
 		int currFrm = 0;
-		int totalFrames = SceneObject::totalFrames;
+		int totalFrames = 120;		// *** frames on the frame slider, grows as keys are added at its end
 		int frmCnt, foldCnt;
-		vector<int> recentKF, nextKF;
 
 		// for gui
 		//
@@ -162,6 +207,13 @@ class ofApp : public ofBaseApp{
 		bool bImage = true;		// show render output
 		bool bHide = false;		// show gui
 		bool bRay = false;		// show camera rays
+		bool bPackets = true;	// trace camera rays as SIMD packets
+		bool bManyLights = false;	// sample lightBudget lights per point instead of shading all of them
+		bool bLive = false;		// render again whenever the scene changes
+		bool bAdaptiveShadows = true;	// area light shadow rays only where visibility is mixed
+		bool bAntialias = true;			// subpixel rays for the pixels on edges
+		bool bFrameParallel = false;	// render animation frames concurrently from keyframe snapshots
+		bool bDistributed = false;		// render animation frames on worker processes
 		bool bAnimate = false;	// turn on animation features
 		bool bPlayback = false; // play keyframe animation
 		bool bPlayRT = false;	// render keyframe animation
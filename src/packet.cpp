@@ -0,0 +1,244 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+//
+//  SIMD packet tracing for camera rays
+//  Kernels for the spheres, cubes, planes and meshes of the compiled scene
+//  and its packet traversal. Every kernel works on world space t, so hits
+//  from different objects (and from single ray fallbacks) compare directly.
+//
+
+#include "compiledscene.h"
+#include "Primitives.h"
+
+
+// // // PACKET INTERSECTION KERNELS // // //
+
+
+//  ***
+//  ray / sphere in object space, solves |o + td|^2 = r^2
+//  the nearest root in front of the ray is used, like glm::intersectRaySphere
+//
+void CompiledScene::packetSphere(const SphereBlock &b, int lane, const RayPacket &rays, int lanes, PacketHit &hit) const {
+	glm::mat4 mInv = laneInverse(b.m, lane);
+	vfloat o[3], d[3];
+	rays.transform(mInv, o, d);
+
+	vfloat a = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+	vfloat bh = o[0] * d[0] + o[1] * d[1] + o[2] * d[2];
+	vfloat c = o[0] * o[0] + o[1] * o[1] + o[2] * o[2] - vfloat(b.r2[lane]);
+	vfloat disc = bh * bh - a * c;
+
+	vfloat sq = vsqrt(vmax(disc, 0.0f));
+	vfloat tNear = (-bh - sq) / a;
+	vfloat tFar = (-bh + sq) / a;
+	vfloat t = select(tNear > 0.0f, tNear, tFar);
+
+	vfloat m = vfloat::lanes(lanes) & (disc >= 0.0f) & (t > 0.0f) & (t < vfloat::load(hit.t));
+	if (!mask(m)) return;
+
+	// object space normal is the hit point over the radius
+	//
+	vfloat n[3], w[3];
+	vfloat inv_r = 1.0f / sqrtf(b.r2[lane]);
+	for (int i = 0; i < 3; i++)
+		n[i] = (o[i] + t * d[i]) * inv_r;
+	packetNormalToWorld(mInv, n, w);
+
+	hit.update(m, t, w[0], w[1], w[2], b.id[lane]);
+}
+
+
+//  ***
+//  slab test against the cube in object space
+//  the face normal comes from the slab that was entered last
+//
+void CompiledScene::packetCube(const CubeBlock &b, int lane, const RayPacket &rays, int lanes, PacketHit &hit) const {
+	glm::mat4 mInv = laneInverse(b.m, lane);
+	vfloat o[3], d[3];
+	rays.transform(mInv, o, d);
+
+	vfloat tNear[3], tFar[3];
+
+	for (int i = 0; i < 3; i++) {
+		vfloat half = b.half[i][lane];
+		vfloat inv = 1.0f / d[i];
+		vfloat t0 = (-half - o[i]) * inv;
+		vfloat t1 = (half - o[i]) * inv;
+		tNear[i] = vmin(t0, t1);
+		tFar[i] = vmax(t0, t1);
+	}
+
+	vfloat tmin = vmax(vmax(tNear[0], tNear[1]), tNear[2]);
+	vfloat tmax = vmin(vmin(tFar[0], tFar[1]), tFar[2]);
+
+	vfloat m = vfloat::lanes(lanes) & (tmin <= tmax) & (tmin > 0.0f) & (tmin < vfloat::load(hit.t));
+	if (!mask(m)) return;
+
+	// face normal points against the ray on the entered axis
+	//
+	vfloat onX = (tNear[0] >= tNear[1]) & (tNear[0] >= tNear[2]);
+	vfloat onY = tNear[1] >= tNear[2];
+	vfloat n[3], w[3];
+	for (int i = 0; i < 3; i++)
+		n[i] = select(d[i] < 0.0f, vfloat(1.0f), vfloat(-1.0f));
+	n[0] = select(onX, n[0], 0.0f);
+	n[1] = select(onX, 0.0f, select(onY, n[1], 0.0f));
+	n[2] = select(onX | onY, 0.0f, n[2]);
+	packetNormalToWorld(mInv, n, w);
+
+	hit.update(m, tmin, w[0], w[1], w[2], b.id[lane]);
+}
+
+
+//  ***
+//  plane test in world space (same as intersectPlane, the plane ignores transformations)
+//
+void CompiledScene::packetPlane(const PlaneItem &pl, const RayPacket &rays, int lanes, PacketHit &hit) const {
+	const glm::vec3 &position = pl.position, &normal = pl.normal;
+	vfloat ox = vfloat::load(rays.ox), oy = vfloat::load(rays.oy), oz = vfloat::load(rays.oz);
+	vfloat dx = vfloat::load(rays.dx), dy = vfloat::load(rays.dy), dz = vfloat::load(rays.dz);
+
+	vfloat den = dx * normal.x + dy * normal.y + dz * normal.z;
+	vfloat t = ((vfloat(position.x) - ox) * normal.x + (vfloat(position.y) - oy) * normal.y +
+				(vfloat(position.z) - oz) * normal.z) / den;
+
+	vfloat px = ox + t * dx, pz = oz + t * dz;
+	vfloat inside = (px > position.x - pl.halfWidth) & (px < position.x + pl.halfWidth) &
+					(pz > position.z - pl.halfHeight) & (pz < position.z + pl.halfHeight);
+
+	vfloat m = vfloat::lanes(lanes) & (vabs(den) > std::numeric_limits<float>::epsilon()) &
+			   (t > 0.0f) & (t < vfloat::load(hit.t)) & inside;
+	if (!mask(m)) return;
+
+	hit.update(m, t, normal.x, normal.y, normal.z, pl.id);
+}
+
+
+//  ***
+//  meshes have no packet kernel, each lane is traced through the mesh BVH on its own
+//
+void CompiledScene::packetMesh(const MeshItem &mi, const RayPacket &rays, int lanes, PacketHit &hit) const {
+	for (int i = 0; i < SIMD_WIDTH; i++) {
+		if (!(lanes & (1 << i))) continue;
+
+		float t = hit.t[i];
+		glm::vec3 normal;
+		if (intersectMesh(mi, Ray(rays.origin(i), rays.direction(i)), t, normal))
+			hit.set(i, t, normal, mi.id);
+	}
+}
+
+
+// // // PACKET TRAVERSAL // // //
+
+
+//  ***
+//  every object of a leaf against the lanes, the spheres and cubes of a block one by one
+//
+void CompiledScene::packetLeaf(const Leaf &leaf, const RayPacket &rays, int lanes, PacketHit &hit) const {
+	for (int b = leaf.first[SPHERES]; b < leaf.first[SPHERES] + leaf.count[SPHERES]; b++)
+		for (int k = 0; k < BATCH_WIDTH; k++)
+			if (spheres[b].lanes & (1 << k)) packetSphere(spheres[b], k, rays, lanes, hit);
+
+	for (int b = leaf.first[CUBES]; b < leaf.first[CUBES] + leaf.count[CUBES]; b++)
+		for (int k = 0; k < BATCH_WIDTH; k++)
+			if (cubes[b].lanes & (1 << k)) packetCube(cubes[b], k, rays, lanes, hit);
+
+	for (int i = leaf.first[PLANES]; i < leaf.first[PLANES] + leaf.count[PLANES]; i++)
+		packetPlane(planes[i], rays, lanes, hit);
+
+	for (int i = leaf.first[MESHES]; i < leaf.first[MESHES] + leaf.count[MESHES]; i++)
+		packetMesh(meshes[i], rays, lanes, hit);
+}
+
+
+void CompiledScene::packetRef(const Ref &ref, const RayPacket &rays, int lanes, PacketHit &hit) const {
+	switch (ref.kind) {
+	case SPHERES: packetSphere(spheres[ref.index], ref.lane, rays, lanes, hit); break;
+	case CUBES: packetCube(cubes[ref.index], ref.lane, rays, lanes, hit); break;
+	case PLANES: packetPlane(planes[ref.index], rays, lanes, hit); break;
+	case MESHES: packetMesh(meshes[ref.index], rays, lanes, hit); break;
+	}
+}
+
+
+//  ***
+//  lanes of the packet that enter node's box before their current closest hit
+//
+int CompiledScene::packetLanes(const Node &node, const RayPacket &rays, const PacketHit &hit, int lanes) const {
+	const float *o[3] = { rays.ox, rays.oy, rays.oz };
+	const float *rd[3] = { rays.rdx, rays.rdy, rays.rdz };
+	vfloat tmin = 0.0f, tmax = vfloat::load(hit.t);
+
+	for (int i = 0; i < 3; i++) {
+		vfloat org = vfloat::load(o[i]), inv = vfloat::load(rd[i]);
+		vfloat t0 = (vfloat(node.box.min[i]) - org) * inv;
+		vfloat t1 = (vfloat(node.box.max[i]) - org) * inv;
+		tmin = vmax(tmin, vmin(t0, t1));
+		tmax = vmin(tmax, vmax(t0, t1));
+	}
+
+	return lanes & mask(tmin <= tmax);
+}
+
+
+//  ***
+//  packet closest hit traversal
+//  each stack entry carries the lanes still alive in that subtree, when a
+//  single lane is left the packet has diverged and the subtree is finished with the single ray traversal
+//
+void CompiledScene::intersectPacket(const RayPacket &rays, PacketHit &hit, int hint) const {
+	// seed the closest hits with the hinted object, see intersect()
+	//
+	if (isCacheable(hint)) packetRef(refs[hint], rays, rays.active, hit);
+	packetLeaf(unbounded, rays, rays.active, hit);
+
+	if (nodes.empty()) return;
+
+	struct Entry { int node, lanes; };
+	Entry stack[64];
+	int top = 0;
+	stack[top++] = { 0, rays.active };
+
+	while (top) {
+		Entry e = stack[--top];
+		const Node &node = nodes[e.node];
+
+		int lanes = packetLanes(node, rays, hit, e.lanes);
+		if (!lanes) continue;
+
+		// diverged, trace the remaining lane alone
+		//
+		if (!(lanes & (lanes - 1))) {
+			int i = 0;
+			while (!(lanes & (1 << i))) i++;
+
+			Ray ray = Ray(rays.origin(i), rays.direction(i));
+			Nearest near;
+			near.t = hit.t[i];
+			if (traverse(e.node, ray, RayLanes(ray), near))
+				hit.set(i, near.t, normalAt(ray, near), idOf(near.kind, near.index, near.lane));
+			continue;
+		}
+
+		if (node.leaf >= 0) {
+			packetLeaf(leaves[node.leaf], rays, lanes, hit);
+			continue;
+		}
+
+		// visit the child nearer to the packet first, judged by the direction of its first lane
+		//
+		int left = e.node + 1, right = node.right;
+		int i = 0;
+		while (!(lanes & (1 << i))) i++;
+		bool leftFirst = glm::dot(nodes[right].box.center() - nodes[left].box.center(), rays.direction(i)) > 0;
+
+		if (leftFirst) { stack[top++] = { right, lanes }; stack[top++] = { left, lanes }; }
+		else { stack[top++] = { left, lanes }; stack[top++] = { right, lanes }; }
+	}
+}
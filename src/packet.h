@@ -0,0 +1,107 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#pragma once
+
+#include "ofMain.h"
+#include "simd.h"
+
+//  ***
+//  pixel footprint of one packet of camera rays (PACKET_W x PACKET_H = SIMD_WIDTH)
+//
+const int PACKET_W = SIMD_WIDTH / 2;
+const int PACKET_H = 2;
+
+
+//  ***
+//  SIMD_WIDTH coherent rays (camera rays through neighbouring pixels)
+//  stored as a structure of arrays so a kernel loads one component for every lane at once
+//
+struct RayPacket {
+	SIMD_ALIGN float ox[SIMD_WIDTH], oy[SIMD_WIDTH], oz[SIMD_WIDTH];
+	SIMD_ALIGN float dx[SIMD_WIDTH], dy[SIMD_WIDTH], dz[SIMD_WIDTH];
+	SIMD_ALIGN float rdx[SIMD_WIDTH], rdy[SIMD_WIDTH], rdz[SIMD_WIDTH];	// 1 / direction for the slab tests
+	int active = 0;		// one bit per lane that carries a ray
+
+	RayPacket() {
+		for (int i = 0; i < SIMD_WIDTH; i++)
+			set(i, glm::vec3(0), glm::vec3(0, 0, -1));
+		active = 0;
+	}
+
+	void set(int lane, const glm::vec3 &p, const glm::vec3 &d) {
+		ox[lane] = p.x; oy[lane] = p.y; oz[lane] = p.z;
+		dx[lane] = d.x; dy[lane] = d.y; dz[lane] = d.z;
+		rdx[lane] = 1 / d.x; rdy[lane] = 1 / d.y; rdz[lane] = 1 / d.z;
+		active |= 1 << lane;
+	}
+
+	glm::vec3 origin(int lane) const { return glm::vec3(ox[lane], oy[lane], oz[lane]); }
+	glm::vec3 direction(int lane) const { return glm::vec3(dx[lane], dy[lane], dz[lane]); }
+
+	// transform every lane into the space of mInv
+	// the direction is not renormalized, so t stays the same in both spaces
+	//
+	void transform(const glm::mat4 &mInv, vfloat o[3], vfloat d[3]) const {
+		vfloat x = vfloat::load(ox), y = vfloat::load(oy), z = vfloat::load(oz);
+		vfloat u = vfloat::load(dx), v = vfloat::load(dy), w = vfloat::load(dz);
+		for (int r = 0; r < 3; r++) {
+			o[r] = x * mInv[0][r] + y * mInv[1][r] + z * mInv[2][r] + mInv[3][r];
+			d[r] = u * mInv[0][r] + v * mInv[1][r] + w * mInv[2][r];
+		}
+	}
+};
+
+
+//  ***
+//  closest hit of every lane of a RayPacket
+//  t is the distance along the world space ray, obj is -1 for a miss
+//
+struct PacketHit {
+	SIMD_ALIGN float t[SIMD_WIDTH];
+	SIMD_ALIGN float nx[SIMD_WIDTH], ny[SIMD_WIDTH], nz[SIMD_WIDTH];
+	int obj[SIMD_WIDTH];
+
+	PacketHit() {
+		for (int i = 0; i < SIMD_WIDTH; i++) {
+			t[i] = std::numeric_limits<float>::infinity();
+			nx[i] = ny[i] = nz[i] = 0;
+			obj[i] = -1;
+		}
+	}
+
+	void set(int lane, float dist, const glm::vec3 &n, int id) {
+		t[lane] = dist;
+		nx[lane] = n.x; ny[lane] = n.y; nz[lane] = n.z;
+		obj[lane] = id;
+	}
+
+	// store the lanes of m
+	//
+	void update(vfloat m, vfloat dist, vfloat x, vfloat y, vfloat z, int id) {
+		select(m, dist, vfloat::load(t)).store(t);
+		select(m, x, vfloat::load(nx)).store(nx);
+		select(m, y, vfloat::load(ny)).store(ny);
+		select(m, z, vfloat::load(nz)).store(nz);
+
+		int bits = mask(m);
+		for (int i = 0; i < SIMD_WIDTH; i++)
+			if (bits & (1 << i)) obj[i] = id;
+	}
+
+	glm::vec3 normal(int lane) const { return glm::vec3(nx[lane], ny[lane], nz[lane]); }
+};
+
+
+//  ***
+//  world normal from an object space normal: transpose(mInv) * n
+//  (same as glm::vec4(n, 1) * mInv used by the single ray intersectors)
+//
+inline void packetNormalToWorld(const glm::mat4 &mInv, vfloat n[3], vfloat w[3]) {
+	for (int r = 0; r < 3; r++)
+		w[r] = n[0] * mInv[r][0] + n[1] * mInv[r][1] + n[2] * mInv[r][2];
+}
@@ -0,0 +1,87 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#include "pool.h"
+#include <new>
+#ifdef _MSC_VER
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#endif
+
+
+//  ***
+//  the free block of this size, or a block of a new chunk of them
+//
+void *BlockPool::allocate(size_t size) {
+	std::lock_guard<std::mutex> lock(mutex);
+	SizeClass &c = classOf(size);
+
+	if (!c.free) {
+		char *chunk = (char *)allocateChunk(c.size * blocksPerChunk);
+		chunks.push_back(chunk);
+		reserved += c.size * blocksPerChunk;
+
+		// thread the blocks of the chunk onto the free list, first block first
+		//
+		for (int i = blocksPerChunk - 1; i >= 0; i--) {
+			void *block = chunk + i * c.size;
+			*(void **)block = c.free;
+			c.free = block;
+		}
+	}
+
+	void *block = c.free;
+	c.free = *(void **)block;
+	inUse += c.size;
+	return block;
+}
+
+
+void BlockPool::deallocate(void *p, size_t size) {
+	if (!p) return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	SizeClass &c = classOf(size);
+	*(void **)p = c.free;
+	c.free = p;
+	inUse -= c.size;
+}
+
+
+//  ***
+//  memory for a chunk on an alignment boundary, operator new only promises what the
+//  largest fundamental type needs (8 bytes on some platforms)
+//  chunks are never freed, so nothing needs the matching aligned free
+//
+void *BlockPool::allocateChunk(size_t bytes) {
+#ifdef _MSC_VER
+	void *p = _aligned_malloc(bytes, alignment);
+#else
+	void *p;
+	if (posix_memalign(&p, alignment, bytes)) p = NULL;
+#endif
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+
+//  ***
+//  sizes are rounded up to the alignment, so a class holds every size that rounds
+//  to it (there are only as many classes as object types)
+//
+BlockPool::SizeClass &BlockPool::classOf(size_t size) {
+	size = (size + alignment - 1) / alignment * alignment;
+
+	for (size_t i = 0; i < classes.size(); i++)
+		if (classes[i].size == size) return classes[i];
+
+	SizeClass c;
+	c.size = size;
+	classes.push_back(c);
+	return classes.back();
+}
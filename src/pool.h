@@ -0,0 +1,171 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+
+//  ***
+//  Names an entry of a SlotMap: the slot and the generation it had when the entry
+//  was added. Slots are reused, but the generation changes each time one is freed, so
+//  the handle of a deleted entry never names the entry that takes its slot.
+//  Generation 0 is the null handle.
+//
+struct Handle {
+	uint32_t index = 0, generation = 0;
+
+	bool valid() const { return generation != 0; }
+	bool operator==(const Handle &h) const { return index == h.index && generation == h.generation; }
+	bool operator!=(const Handle &h) const { return !(*this == h); }
+};
+
+
+//  ***
+//  Allocator for the scene objects and keyframes (see SceneObject::operator new)
+//  Blocks of each size are cut from chunks of blocksPerChunk, freed blocks go on a free
+//  list of their size and are handed out again before a new chunk is cut, so an editing
+//  session that keeps adding and deleting objects reuses the same memory. Chunks are
+//  never returned, and addresses stay put for the life of a block.
+//  Allocation is thread safe: render snapshots clone objects on the render threads.
+//
+class BlockPool {
+public:
+	// // // VARIABLES // // //
+
+	// every chunk and block starts on this boundary, no pooled type may need more
+	//
+	const static size_t alignment = 16;
+
+	// // // FUNCTIONS // // //
+
+	BlockPool(int blocksPerChunk = 64) : blocksPerChunk(blocksPerChunk) {}
+	BlockPool(const BlockPool &) = delete;
+	BlockPool &operator=(const BlockPool &) = delete;
+
+	void *allocate(size_t size);
+	void deallocate(void *p, size_t size);
+
+	size_t bytesReserved() const { return reserved; }	// in chunks
+	size_t bytesInUse() const { return inUse; }			// in blocks handed out
+
+private:
+	// // // VARIABLES // // //
+
+	// blocks of one size, the first bytes of a free block point to the next one
+	//
+	struct SizeClass {
+		size_t size;
+		void *free = NULL;
+	};
+
+	int blocksPerChunk;
+	std::mutex mutex;
+	std::vector<SizeClass> classes;		// a handful, one per object type
+	std::vector<char *> chunks;
+	size_t reserved = 0, inUse = 0;
+
+	// // // FUNCTIONS // // //
+
+	SizeClass &classOf(size_t size);
+	static void *allocateChunk(size_t bytes);
+};
+
+
+//  ***
+//  Unordered list of pointers with O(1) insert and delete
+//  The entries are kept packed in one array, which is what iteration and operator[]
+//  see; an entry is deleted by moving the last one into its place. Each entry also
+//  owns a slot, and the Handle of that slot is stored in the entry's handleOf member,
+//  so erase() needs no search and code that must refer to an entry across edits can
+//  keep its Handle: get() returns NULL once the entry has been erased.
+//  Side tables indexed by Handle::index need no fixing up when entries are erased.
+//
+template <class T, Handle T::*handleOf>
+class SlotMap {
+public:
+	// // // FUNCTIONS // // //
+
+	typedef typename std::vector<T *>::const_iterator const_iterator;
+
+	size_t size() const { return dense.size(); }
+	bool empty() const { return dense.empty(); }
+	T *operator[](size_t i) const { return dense[i]; }
+	const_iterator begin() const { return dense.begin(); }
+	const_iterator end() const { return dense.end(); }
+	const std::vector<T *> &items() const { return dense; }
+
+	// add item at the end, its handle is stored in item->*handleOf and returned
+	//
+	Handle push_back(T *item) {
+		uint32_t s;
+		if (freeSlots.size()) {
+			s = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else {
+			s = (uint32_t)slots.size();
+			slots.push_back(Slot());
+		}
+
+		slots[s].dense = (uint32_t)dense.size();
+		dense.push_back(item);
+		slotOf.push_back(s);
+
+		Handle h;
+		h.index = s;
+		h.generation = slots[s].generation;
+		item->*handleOf = h;
+		return h;
+	}
+
+	// remove item (the last entry takes its place), false if it is not in the map
+	//
+	bool erase(T *item) {
+		Handle h = item->*handleOf;
+		if (get(h) != item) return false;
+
+		uint32_t d = slots[h.index].dense;
+		dense[d] = dense.back();
+		slotOf[d] = slotOf.back();
+		slots[slotOf[d]].dense = d;
+		dense.pop_back();
+		slotOf.pop_back();
+
+		if (++slots[h.index].generation == 0) slots[h.index].generation = 1;
+		freeSlots.push_back(h.index);
+		item->*handleOf = Handle();
+		return true;
+	}
+
+	// the entry h was given for, NULL if it has been erased
+	//
+	T *get(Handle h) const {
+		if (h.index >= slots.size() || slots[h.index].generation != h.generation) return NULL;
+		return dense[slots[h.index].dense];
+	}
+
+	void clear() {
+		while (dense.size()) erase(dense.back());
+	}
+
+private:
+	// // // VARIABLES // // //
+
+	struct Slot {
+		uint32_t dense = 0;			// position of the entry in dense
+		uint32_t generation = 1;
+	};
+
+	std::vector<T *> dense;
+	std::vector<uint32_t> slotOf;	// slot of each entry of dense
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeSlots;
+};
@@ -1,40 +1,51 @@
 #ifndef _RAY_H_
 #define _RAY_H_
 
-#include "vector3.h"
-
-/*
- * Ray class, for use with the optimized ray-box intersection test
- * described in:
- *
- *      Amy Williams, Steve Barrus, R. Keith Morley, and Peter Shirley
- *      "An Efficient and Robust Ray-Box Intersection Algorithm"
- *      Journal of graphics tools, 10(1):49-54, 2005
- * 
- */
-
-class _Ray {
-  public:
-    _Ray() { }
-    _Ray(Vector3 o, Vector3 d) {
-      origin = o;
-      direction = d;
-      inv_direction = Vector3(1/d.x(), 1/d.y(), 1/d.z());
-      sign[0] = (inv_direction.x() < 0);
-      sign[1] = (inv_direction.y() < 0);
-      sign[2] = (inv_direction.z() < 0);
-    }
-    _Ray(const _Ray &r) {
-      origin = r.origin;
-      direction = r.direction;
-      inv_direction = r.inv_direction;
-      sign[0] = r.sign[0]; sign[1] = r.sign[1]; sign[2] = r.sign[2];
-    }
-
-    Vector3 origin;
-    Vector3 direction;
-    Vector3 inv_direction;
-    int sign[3];
+#include "ofMain.h"
+
+//  General Purpose Ray class
+//
+//  ***
+//  The reciprocal direction and its signs are computed once per ray, so the
+//  box tests (AABB and the BVH traversals) need no divides and no branches
+//  on the direction, as in the ray-box test of
+//
+//      Amy Williams, Steve Barrus, R. Keith Morley, and Peter Shirley
+//      "An Efficient and Robust Ray-Box Intersection Algorithm"
+//      Journal of graphics tools, 10(1):49-54, 2005
+//
+//  Packets of rays for the SIMD kernels are in packet.h (RayPacket).
+//
+class alignas(16) Ray {
+public:
+	glm::vec3 p, d;
+	glm::vec3 invD;		// 1 / d
+	int sign[3];		// 1 where d is negative: index of the box corner that is entered last
+
+	Ray(glm::vec3 p, glm::vec3 d) { 
+		this->p = p; this->d = d; 
+		invD = 1.0f / d;
+		sign[0] = (invD.x < 0);
+		sign[1] = (invD.y < 0);
+		sign[2] = (invD.z < 0);
+	}
+
+	void draw(float t) { 
+		ofDrawLine(p, p + t * d); 
+	}
+
+	glm::vec3 evalPoint(float t) const {
+		return (p + t * d);
+	}
+};
+
+
+//  ***
+//  hit record: distance along the ray, point and normal (in the space of the ray)
+//
+struct Hit {
+	float t = std::numeric_limits<float>::infinity();
+	glm::vec3 point, normal;
 };
 
 #endif // _RAY_H_
@@ -8,203 +8,199 @@
 #include "ofApp.h"
 
 
+// // // BACKGROUND RENDERING // // //
+
+
 //  ***
-//  raytracing function: determines the color values for every pixel 
-//  by iterating through each object in the scene
+//  start rendering a snapshot of the scene in the background, replacing any render in progress
+//  a progressive render shows coarse passes first (every progressiveStep-th pixel, then
+//  every half of that ...), save writes the image to the data folder once it is complete
+//  seed starts the sample sequences, animation frames use their frame number
 //
-void ofApp::raytrace() {
-	float width, height, w_div, h_div, w, h, dist, near_dist;
-	glm::vec3 pt, norm, near_pt, near_norm, dNm, pNm;
-	bool hit, shadow, inSL;
-	int near_obj;
-	ofColor shade;
+void ofApp::startRender(bool progressive, bool save, uint32_t seed) {
+	cancelRender();
 
-	width = renderCam.view.width();
-	height = renderCam.view.height();
-	w_div = 1 / width;
-	h_div = 1 / height;
+	renderScene = make_shared<RenderScene>(scene.items(), lights.items(), *this);
+	renderScene->seed = seed;
+	renderSignature = sceneSignature();
+	renderFile = save ? nextRenderFile() : "";
+	renderFrames = 0;
+	renderCancel = false;
+	renderPasses = shownPasses = 0;
+	renderDone = false;
+	renderStart = ofGetElapsedTimef();
 
-	//get N samples of points in the area light
-	//
-	glm::vec3 pts[2][100];
-	float u, v;
+	renderThread = std::thread(&ofApp::renderLoop, this, renderScene, progressive ? progressiveStep : 1);
+}
 
-	//for every light in the scene
-	//
-	for (size_t l = 0; l < lights.size(); l++) {
-		if (lights[l]->type == 2) {
-			for (int i = 0; i < lights[l]->N; i++) {
-				//get random u,v value b/w [0,1]
-				//
-				u = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-				v = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-				pts[l][i] = lights[l]->area.toWorld(u, v);
-			}
+
+//  ***
+//  stop the render in progress (within a tile per render thread), its result is dropped
+//
+void ofApp::cancelRender() {
+	if (!renderThread.joinable()) return;
+
+	renderCancel = true;
+	renderThread.join();
+	renderFrames = 0;
+}
+
+
+//  ***
+//  runs on renderThread: the passes from coarse to fine, then the penumbra and
+//  anti-aliasing passes, each one is handed to pollRender
+//
+void ofApp::renderLoop(shared_ptr<RenderScene> rs, int firstStep) {
+	auto show = [&](int step, bool done) {
+		std::lock_guard<std::mutex> guard(renderLock);
+		rs->fillBlocks(step, preview);
+		renderPasses++;
+		renderDone = done;
+	};
+
+	rs->prepare();
+
+	for (int step = firstStep; step >= 1; step /= 2) {
+		if (!rs->renderPass(pool, step, step == firstStep, renderCancel)) return;
+		show(step, step == 1 && !rs->bAdaptiveShadows && !rs->bAntialias);
+	}
+
+	if (rs->bAdaptiveShadows) {
+		if (!rs->penumbraPass(&pool, renderCancel)) return;
+		show(1, !rs->bAntialias);
+	}
+	if (rs->bAntialias && rs->antialiasPass(&pool, renderCancel)) show(1, true);
+}
+
+
+//  ***
+//  main thread side of the background render, called every update(): shows the newest
+//  finished pass through image and saves the image once the render is complete
+//  wait blocks until the render thread is done
+//
+void ofApp::pollRender(bool wait) {
+	if (!renderThread.joinable()) return;
+	if (wait) renderThread.join();
+
+	bool done;
+	{
+		std::lock_guard<std::mutex> guard(renderLock);
+		if (renderPasses != shownPasses) {
+			image.setFromPixels(preview);
+			shownPasses = renderPasses;
 		}
+		done = renderDone;
 	}
+	if (!done) return;
 
-	//start at bottom left
-	//for every pixel
-	//
-	for (float i = 1; i <= width; i++) {
-		for (float j = 1; j <= height; j++) {
-			// get the ray at the pixel's center from the camera
-			//
-			w = w_div * i - w_div / 2;
-			h = h_div * j - h_div / 2;
-			Ray ray = renderCam.getRay(w, h);
+	if (renderThread.joinable()) renderThread.join();
+	stats = renderScene->stats;
 
-			// default values
-			//
-			hit = false;
-			near_dist = std::numeric_limits<float>::infinity();
-			near_obj = -1;
+	if (renderFrames) {
+		std::cout << "Rendering complete! (" << renderFrames << " frames, " << ofGetElapsedTimef() - renderStart << " s, "
+			<< pool.size() << " frames at a time)" << endl;
+		renderFrames = 0;
+	}
+	else if (renderFile.size()) {
+		image.save(renderFile);
+		if (bPlayback && !bPlayRT) std::cout << "Rendering complete!" << endl;
+		if (!bPlayback) {
+			std::cout << "Rendering complete! (" << ofGetElapsedTimef() - renderStart << " s)" << endl;
+			std::cout << "cache hit rate: primary " << 100.0 * stats.primaryCached / std::max(stats.primary, 1L)
+				<< "%, occluder " << 100.0 * stats.shadowCached / std::max(stats.shadowBlocked, 1L)
+				<< "% (" << stats.shadowBlocked << " of " << stats.shadow << " shadow rays blocked)" << endl;
+			if (bAdaptiveShadows) std::cout << stats.penumbra << " area light shadings refined in penumbrae" << endl;
+			if (bAntialias) std::cout << stats.antialiased << " pixels anti-aliased with " << stats.subpixel
+				<< " subpixel rays (" << filter.name() << " filter)" << endl;
+			std::cout << pool.size() << " render threads, " << stats.steals << " tiles stolen" << endl;
+		}
+	}
+}
 
-			//for every object in the scene
-			//
-			for (size_t k = 0; k < scene.size(); k++) {
-				//object is not a light
-				if (typeid(*scene[k]) != typeid(Light)) {	
-					//check if ray intersects object
-					if (scene[k]->intersect(ray, pt, norm, renderCam.position)) {
-						dist = glm::length(pt - renderCam.position);
-
-						// found a closer object, update nearest object values
-						if (dist < near_dist) {
-							near_dist = dist;
-							near_obj = k;
-							near_norm = norm;
-							near_pt = pt;
-						}
-
-						hit = true;
-					}
-				}
-			} //end nearest object
 
-			//object intersected with the view ray, add shading
-			//
-			if (hit) {
-				//default shading with ambient lighting
-				shade = scene[near_obj]->diffuseColor * ambientColor;
+//  ***
+//  render every frame of the animation into a new Animation_ folder in the background
+//  the frames are independent snapshots of the keyframes, rendered several at a time
+//  (one per render thread) instead of one after the other as playback advances
+//
+void ofApp::startAnimationRender() {
+	cancelRender();
 
-				//for every light in the scene
-				//
-				for (size_t l = 0; l < lights.size(); l++) {
-					//area light, soft shadows
-					//
-					if (lights[l]->type == 2) {
-						//store all the computed shades
-						glm::vec3 shd = glm::vec3(0, 0, 0);
-						ofColor temp;
-
-						//calculate shade for every sample light point
-						//
-						for (int n = 0; n < lights[l]->N; n++) {
-							//compute a shadow ray for each sample
-							Ray shadow_ray = Ray(near_pt, glm::normalize(pts[l][n] - near_pt));
-
-							//to determine if a shadow is cast on near_obj, check if shadow_ray intersects with any other object
-							shadow = false;
-
-							for (size_t m = 0; m < scene.size(); m++) {
-								//for any other object
-								if (near_obj != m) 
-									//if ray intersects object, shadow exists
-									if (scene[m]->intersect(shadow_ray, pt, norm, renderCam.position)) {
-										shadow = true;
-
-										if (typeid(*scene[m]) == typeid(Cube)) {
-											//check if box is further away from the light than near_obj
-											float distM = glm::length(pt - lights[l]->getPosition());
-											float distN = glm::length(near_pt - lights[l]->getPosition());
-											if (distM > distN)
-												shadow = false;
-										}
-
-										break;
-									}
-							}
-
-							//no shadow detected, calculate phong shading
-							//
-							if (!shadow) {
-								temp = phong(ray.d, near_norm, l, scene[near_obj]->diffuseColor, scene[near_obj]->specularColor);
-								shd += glm::vec3(temp.r, temp.g, temp.b);
-							}
-						}
-
-						//calculate the average of all the computed shades
-						shd = shd / lights[l]->N;
-
-						//convert to a color and add to the ambient shade
-						shade += ofColor(shd.x, shd.y, shd.z);
-					}
+	string folder = newAnimationFolder();
 
-					//point or spot light, hard shadows only
-					//
-					else {
-						//create ray from the nearest point of intersection from the raytrace to the light's position
-						Ray shadow_ray = Ray(near_pt, glm::normalize(lights[l]->getPosition() - near_pt));
-
-						//to determine if a shadow is cast on near_obj, check if shadow_ray intersects with any other object
-						shadow = false;
-
-						for (size_t m = 0; m < scene.size(); m++) {
-							//for any other object that is not a light
-							if (near_obj != m && typeid(*scene[m]) != typeid(Light)) 
-								//if ray intersects object, shadow exists
-								if (scene[m]->intersect(shadow_ray, pt, norm, renderCam.position)) {
-									shadow = true;
-
-									if (typeid(*scene[m]) == typeid(Cube)) {
-										//check if box is further away from the light than near_obj
-										float distM = glm::length(pt - lights[l]->getPosition());
-										float distN = glm::length(near_pt - lights[l]->getPosition());
-										if (distM > distN)
-											shadow = false;
-									}
-
-									break;
-								}
-						}
-
-						//no shadow detected, calculate phong shading
-						//
-						if (!shadow){
-							//spoitlight
-							//
-							if (lights[l]->type == 1) {
-								//calculate if shadow_ray is within the spotlight breadth
-								inSL = false;
-								dNm = glm::normalize(lights[l]->direction);
-								pNm = glm::normalize(lights[l]->getPosition() - near_pt);
-								if (glm::dot(dNm, pNm) < glm::cos(lights[l]->angle + 3.15)) inSL = true;
-							}
-
-							//point light or within spotlight
-							//
-							if(lights[l]->type==0 || inSL)
-								shade += phong(ray.d, near_norm, l, scene[near_obj]->diffuseColor, scene[near_obj]->specularColor);							
-						}
-					} //end if light type
-				} //end lights for loop
-
-				//shading calculated, set pixel to shade color
-				image.setColor(i - 1, height - j, shade);
-			} //end hit true
-
-			//no object has an intersection at this pixel, set to background color
-			//
-			else 
-				image.setColor(i - 1, height - j, bkgndColor);
-		} //end j loop
-	} //end i loop
-	
-	image.update();
+	renderScene = make_shared<RenderScene>(scene.items(), lights.items(), *this);
+	renderSignature = sceneSignature();
+	renderFile = "";
+	renderFrames = animationLength();
+	renderCancel = false;
+	renderPasses = shownPasses = 0;
+	renderDone = false;
+	renderStart = ofGetElapsedTimef();
+
+	renderThread = std::thread(&ofApp::animationLoop, this, renderScene, folder);
+}
+
+
+//  ***
+//  runs on renderThread: each task builds, renders and saves one frame, the newest
+//  finished frame is shown through pollRender; base collects the counters
+//
+void ofApp::animationLoop(shared_ptr<RenderScene> base, string folder) {
+	pool.parallelFor(renderFrames, [&](int frame, int worker) {
+		if (renderCancel) return;
+
+		RenderScene rs(*base, frame);
+		rs.prepare();
+		if (!rs.renderFrame(renderCancel)) return;
+		ofPixels pixels;
+		rs.fillBlocks(1, pixels);
+		ofSaveImage(pixels, folder + "//frame_" + to_string(frame) + ".png");
+
+		std::lock_guard<std::mutex> guard(renderLock);
+		preview = pixels;
+		renderPasses++;
+		base->stats.add(rs.stats);
+	});
+
+	std::lock_guard<std::mutex> guard(renderLock);
+	base->stats.steals = pool.numSteals;
+	renderDone = !renderCancel;
+}
+
+
+//  ***
+//  like startAnimationRender, but the frames are rendered by the worker processes
+//  connected to coordinator; update() collects them
+//
+void ofApp::startDistributedRender() {
+	coordinator.start(make_shared<RenderScene>(scene.items(), lights.items(), *this), animationLength(), newAnimationFolder());
+}
+
+
+//  ***
+//  frames up to the last keyframe of any object, where playback ends
+//
+int ofApp::animationLength() {
+	int frames = 1;
+	for (size_t i = 1; i < scene.size(); i++)
+		if (scene[i]->isSelectable) frames = std::max(frames, scene[i]->keys.lastFrame() + 1);
+	return frames;
+}
+
+
+//  ***
+//  render the scene at full resolution, save it and wait for it
+//
+void ofApp::raytrace() {
+	startRender(false, true);
+	pollRender(true);
+}
 
-	//save in data folder
-	//	
+
+//  ***
+//  the next free file name in the data folder (or the animation's folder during playback)
+//
+string ofApp::nextRenderFile() {
 	boost::filesystem::path fp = boost::filesystem::current_path();
 	string file = fp.string();
 	if (bPlayback)
@@ -216,30 +212,891 @@ void ofApp::raytrace() {
 	string p(filename);
 
 	int i = 0;
-	while (boost::filesystem::exists(p) && i < totalFrames) {
+	while (boost::filesystem::exists(p)) {
 		stringstream s;
 		s << file << "_" << ++i<< ".png";
 		p = s.str();
 	}
 
-	image.save(p);
+	return p;
+}
+
+
+//  ***
+//  number of the next free Animation_ folder in the data folder
+//
+int ofApp::nextAnimationFolder() {
+	boost::filesystem::path fp = boost::filesystem::current_path();
+	string folder = fp.string();
+	folder += "//data//Animation";
+	string tempFolder = folder + "_0";
+	string p(tempFolder);
+
+	int i = 0;
+	while (boost::filesystem::exists(p) && i < 50) {
+		stringstream s;
+		s << folder << "_" << ++i;
+		p = s.str();
+	}
+	return i;
+}
+
+
+//  ***
+//  create the next free Animation_ folder for the frames of an animation render
+//
+string ofApp::newAnimationFolder() {
+	foldCnt = nextAnimationFolder();
+	string folder = boost::filesystem::current_path().string() + "//data//Animation_" + to_string(foldCnt);
+	boost::filesystem::create_directories(folder);
+	return folder;
+}
+
+
+//  ***
+//  hash of everything the render reads from the scene, a render whose signature is
+//  out of date is restarted (see update())
+//
+size_t ofApp::sceneSignature() {
+	size_t h = 0;
+	auto mix = [&](size_t v) { h ^= v + 0x9e3779b9 + (h << 6) + (h >> 2); };
+	auto mixf = [&](float f) { mix(std::hash<float>()(f)); };
+	auto mixc = [&](const ofColor &c) { mix(c.r | (c.g << 8) | (c.b << 16)); };
+
+	mix(scene.size());
+	for (size_t i = 0; i < scene.size(); i++) {
+		SceneObject *o = scene[i];
+		mix(o->handle.index);
+		mix(o->handle.generation);
+		mix(o->getStamp());
+		mixc(o->diffuseColor);
+		mixc(o->specularColor);
+
+		if (typeid(*o) == typeid(Light)) {
+			Light *l = (Light *)o;
+			mix(l->type);
+			mix(l->N);
+			mixf(l->intensity);
+			mixf(l->power);
+			mixf(l->angle);
+			mixf(l->area.width());
+			mixf(l->area.height());
+		}
+	}
+
+	mixf(renderCam.position.x);
+	mixf(renderCam.position.y);
+	mixf(renderCam.position.z);
+	mixc(ambientColor);
+	mixc(bkgndColor);
+	mix(meshLayout);
+	mix(tileSize);
+	mixf(lightCutoff);
+	mix(lightBudget);
+	mix(bManyLights);
+	mix(bPackets);
+	mix(samplePattern);
+	mix(bAdaptiveShadows);
+	mix(shadowBatch);
+	mixf(penumbraScale);
+	mix(bAntialias);
+	mix(aaSamples);
+	mixf(aaColor);
+	mixf(aaNormal);
+	mix(filter.type);
+	mixf(filter.radius);
+	return h;
+}
+
+
+// // // RENDER SCENE // // //
+
+
+//  ***
+//  clones the objects and copies the camera and settings
+//  the clones' matrices are brought up to date here on the main thread, the
+//  render threads only read them (see SceneObject::worldPosition)
+//
+RenderScene::RenderScene(const vector<SceneObject *> &objs, const vector<Light *> &ls, const ofApp &app) :
+	renderCam(app.renderCam) {
+	ambientColor = app.ambientColor;
+	bkgndColor = app.bkgndColor;
+	tileSize = app.tileSize;
+	lightCutoff = app.lightCutoff;
+	lightBudget = app.lightBudget;
+	bManyLights = app.bManyLights;
+	bPackets = app.bPackets;
+	bAdaptiveShadows = app.bAdaptiveShadows;
+	shadowBatch = app.shadowBatch;
+	penumbraScale = app.penumbraScale;
+	samplePattern = app.samplePattern;
+	bAntialias = app.bAntialias;
+	aaSamples = app.aaSamples;
+	aaColor = app.aaColor;
+	aaNormal = app.aaNormal;
+	filter = app.filter;
+	seed = 0;
+
+	//the clones own copies of the keyframes, which frame snapshots read
+	//
+	cloneScene(objs, ls);
+
+	for (size_t i = 0; i < scene.size(); i++)
+		scene[i]->updateMatrix();
+	for (size_t l = 0; l < lights.size(); l++)
+		lights[l]->area.updateMatrix();
+
+	buffer.allocate(renderCam.view.width(), renderCam.view.height());
+}
+
+
+//  ***
+//  the channels of the objects are evaluated at frame like playback would (the scene
+//  root, scene[0], is not animated), area lights follow their light as Light::draw does
+//  the frame number seeds the sample sequences, so a frame always renders the same
+//
+RenderScene::RenderScene(const RenderScene &base, int frame) :
+	renderCam(base.renderCam) {
+	ambientColor = base.ambientColor;
+	bkgndColor = base.bkgndColor;
+	tileSize = base.tileSize;
+	lightCutoff = base.lightCutoff;
+	lightBudget = base.lightBudget;
+	bManyLights = base.bManyLights;
+	bPackets = base.bPackets;
+	bAdaptiveShadows = base.bAdaptiveShadows;
+	shadowBatch = base.shadowBatch;
+	penumbraScale = base.penumbraScale;
+	samplePattern = base.samplePattern;
+	bAntialias = base.bAntialias;
+	aaSamples = base.aaSamples;
+	aaColor = base.aaColor;
+	aaNormal = base.aaNormal;
+	filter = base.filter;
+	seed = frame;
+
+	cloneScene(base.scene, base.lights);
+
+	for (size_t i = 1; i < scene.size(); i++)
+		if (scene[i]->isSelectable) scene[i]->evalFrame(frame);
+
+	//a frame is a still, it has no use for the keyframes
+	//
+	for (size_t i = 0; i < scene.size(); i++)
+		scene[i]->keys.clear();
+
+	for (size_t i = 0; i < scene.size(); i++)
+		scene[i]->updateMatrix();
+	for (size_t l = 0; l < lights.size(); l++) {
+		lights[l]->area.position = lights[l]->worldPosition();
+		lights[l]->area.updateMatrix();
+	}
+
+	buffer.allocate(renderCam.view.width(), renderCam.view.height());
+}
+
+
+RenderScene::~RenderScene() {
+	for (size_t i = 0; i < scene.size(); i++)
+		delete scene[i];
+}
+
+
+//  ***
+//  clone every object, then point parents and children at the clones
+//
+void RenderScene::cloneScene(const vector<SceneObject *> &objs, const vector<Light *> &ls) {
+	std::map<const SceneObject *, SceneObject *> copies;
+	for (size_t i = 0; i < objs.size(); i++) {
+		scene.push_back(objs[i]->clone());
+		copies[objs[i]] = scene.back();
+	}
+
+	for (size_t i = 0; i < scene.size(); i++) {
+		SceneObject *o = scene[i];
+		if (o->parent) o->parent = copies[o->parent];
+		for (size_t c = 0; c < o->childList.size(); c++)
+			o->childList[c] = copies[o->childList[c]];
+	}
+
+	for (size_t l = 0; l < ls.size(); l++)
+		lights.push_back((Light *)copies[ls[l]]);
+}
+
+
+void RenderScene::prepare() {
+	int width = buffer.getWidth(), height = buffer.getHeight();
+	size_t count = buffer.size();
+	sampled.assign(count, 0);
+	penumbrae.assign(count, 0);
+	hitObj.assign(count, -1);
+	hitNorm.assign(count, glm::vec3(0, 0, 0));
+	edges.assign(count, 0);
+
+	//the masks have one bit per area light sampled adaptively, lights past the 32nd
+	//get none and are always sampled fully rather than share one
+	//
+	penumbraBit.assign(lights.size(), 0);
+	int bits = 0;
+	for (size_t l = 0; l < lights.size() && bits < 32; l++)
+		if (lights[l]->type == 2 && lights[l]->N > minAdaptiveSamples) penumbraBit[l] = 1u << bits++;
+
+	//neighbouring tasks get neighbouring tiles, so the run of tasks a render thread
+	//takes covers a compact part of the image
+	//
+	int tilesX = (width + tileSize - 1) / tileSize;
+	int tilesY = (height + tileSize - 1) / tileSize;
+	tileOrder.resize(tilesX * tilesY);
+	for (int t = 0; t < tilesX * tilesY; t++) tileOrder[t] = t;
+	std::sort(tileOrder.begin(), tileOrder.end(), [&](int a, int b) {
+		return FrameBuffer::morton(a / tilesY, a % tilesY) < FrameBuffer::morton(b / tilesY, b % tilesY);
+	});
+
+	compiled.build(scene);
+	if (bManyLights) lightTree.build(lights, lightCutoff);
+}
+
+
+//  ***
+//  raytracing function: determines the color values for the pixels of one pass
+//  by finding the nearest object in the compiled scene
+//  the image is split into tiles of tileSize x tileSize pixels, rendered in parallel;
+//  each worker thread has its own Tile state and every tile starts it over, so a
+//  pixel's color does not depend on which thread rendered it, in which order or pass
+//
+bool RenderScene::renderPass(ThreadPool &pool, int step, bool first, const std::atomic<bool> &cancel) {
+	int width = renderCam.view.width();
+	int height = renderCam.view.height();
+	int tilesX = (width + tileSize - 1) / tileSize;
+	int tilesY = (height + tileSize - 1) / tileSize;
+	vector<Tile> tiles(pool.size());
+
+	pool.parallelFor(tilesX * tilesY, [&](int task, int worker) {
+		if (cancel) return;
+		int t = tileOrder[task];
+		renderTile(1 + (t / tilesY) * tileSize, 1 + (t % tilesY) * tileSize, step, first, tiles[worker]);
+	});
+
+	if (cancel) return false;
+
+	for (size_t i = 0; i < tiles.size(); i++)
+		stats.add(tiles[i].stats);
+	stats.steals += pool.numSteals;
+	return true;
+}
+
+
+bool RenderScene::renderFrame(const std::atomic<bool> &cancel) {
+	int width = renderCam.view.width();
+	int height = renderCam.view.height();
+	Tile tile;
+
+	for (int ti = 1; ti <= width; ti += tileSize) {
+		for (int tj = 1; tj <= height; tj += tileSize) {
+			if (cancel) return false;
+			renderTile(ti, tj, 1, true, tile);
+		}
+	}
+
+	stats.add(tile.stats);
+
+	return (!bAdaptiveShadows || penumbraPass(NULL, cancel)) && (!bAntialias || antialiasPass(NULL, cancel));
+}
+
+
+//  ***
+//  image rows run top to bottom while render rows count from 1 at the bottom, the pixel
+//  standing for a block is the bottom left one of the step x step block; it is its own
+//  source, so the blocks can be filled in place
+//
+void RenderScene::fillBlocks(int step, ofPixels &out) const {
+	int width = buffer.getWidth(), height = buffer.getHeight();
+	buffer.tonemap(out);
+	if (step == 1) return;
+
+	for (int y = 0; y < height; y++) {
+		int py = height - y;
+		int src = height - (py - (py - 1) % step);
+		for (int x = 0; x < width; x++)
+			out.setColor(x, y, out.getColor(x - x % step, src));
+	}
+}
+
+
+//  ***
+//  call f for every tile, on the pool or on the calling thread (pool NULL), with the
+//  Tile state of the thread running it; stops handing out tiles once cancelled
+//
+void RenderScene::forTiles(ThreadPool *pool, vector<Tile> &tiles, const std::atomic<bool> &cancel,
+						   const std::function<void(int ti, int tj, Tile &tile)> &f) {
+	int tilesY = (buffer.getHeight() + tileSize - 1) / tileSize;
+	int count = tileOrder.size();
+
+	auto task = [&](int task, int worker) {
+		int t = tileOrder[task];
+		if (!cancel) f(1 + (t / tilesY) * tileSize, 1 + (t % tilesY) * tileSize, tiles[worker]);
+	};
+	if (pool) {
+		pool->parallelFor(count, task);
+		stats.steals += pool->numSteals;
+	}
+	else
+		for (int t = 0; t < count; t++) task(t, 0);
+}
+
+
+//  ***
+//  the first shadow rays can miss the penumbra of a small occluder, but then they
+//  rarely miss it at every pixel around it: a pixel next to one with a penumbra is
+//  shaded again with that light sampled fully, and where that finds a penumbra too the
+//  next ring of pixels follows. Each round finds the pixels to shade from the state of the
+//  round before, so the result does not depend on the order of the pixels or the passes
+//
+bool RenderScene::penumbraPass(ThreadPool *pool, const std::atomic<bool> &cancel) {
+	vector<Tile> tiles(pool ? pool->size() : 1);
+	vector<uint32_t> grow(penumbrae.size());
+
+	for (;;) {
+		forTiles(pool, tiles, cancel, [&](int ti, int tj, Tile &) { growPenumbrae(ti, tj, grow); });
+		if (cancel) return false;
+		if (std::find_if(grow.begin(), grow.end(), [](uint32_t g) { return g != 0; }) == grow.end()) break;
+
+		forTiles(pool, tiles, cancel, [&](int ti, int tj, Tile &tile) { refineTile(ti, tj, grow, tile); });
+		if (cancel) return false;
+	}
+
+	for (size_t i = 0; i < tiles.size(); i++)
+		stats.add(tiles[i].stats);
+	return true;
+}
+
+
+//  ***
+//  grow = the lights with a penumbra at any of the 8 pixels around each pixel of the tile
+//  that are not sampled fully there yet
+//
+void RenderScene::growPenumbrae(int ti, int tj, vector<uint32_t> &grow) const {
+	int width = buffer.getWidth(), height = buffer.getHeight();
+
+	for (int px = ti; px < ti + tileSize && px <= width; px++) {
+		for (int py = tj; py < tj + tileSize && py <= height; py++) {
+			size_t i = pixel(px, py);
+			uint32_t near = 0;
+
+			for (int y = std::max(py - 1, 1); y <= std::min(py + 1, height); y++)
+				for (int x = std::max(px - 1, 1); x <= std::min(px + 1, width); x++)
+					near |= penumbrae[pixel(x, y)];
+			grow[i] = near & ~sampled[i];
+		}
+	}
+}
+
+
+//  ***
+//  traces the tile's pixels with grow bits again and shades them with those lights
+//  sampled fully, like renderTile
+//
+void RenderScene::refineTile(int ti, int tj, const vector<uint32_t> &grow, Tile &tile) {
+	float width = buffer.getWidth(), height = buffer.getHeight();
+	float w_div = 1 / width, h_div = 1 / height;
+	glm::vec3 near_pt, near_norm;
+	int near_obj;
+	bool hit;
+	AABB tileBox;
+
+	tile.sampler.setup(samplePattern, seed);
+	tile.samples.clear();
+	tile.lastHit = -1;
+	tile.lastOccluder.assign(lights.size(), -1);
+
+	for (int px = ti; px < ti + tileSize && px <= width; px++) {
+		for (int py = tj; py < tj + tileSize && py <= height; py++) {
+			if (!grow[pixel(px, py)]) continue;
+
+			//the same ray and hit as the pass that traced the pixel
+			//
+			Ray ray = renderCam.getRay(w_div * px - w_div / 2, h_div * py - h_div / 2);
+			if (bPackets) {
+				RayPacket packet;
+				PacketHit packetHit;
+				packet.set(0, ray.p, ray.d);
+				compiled.intersectPacket(packet, packetHit, tile.lastHit);
+
+				ray = Ray(packet.origin(0), packet.direction(0));
+				near_obj = packetHit.obj[0];
+				hit = (near_obj >= 0);
+				near_pt = ray.evalPoint(packetHit.t[0]);
+				near_norm = packetHit.normal(0);
+			}
+			else
+				hit = compiled.intersect(ray, near_pt, near_norm, near_obj, tile.lastHit);
+
+			if (hit) {
+				tile.samples.push_back({ ray.p, ray.d, near_pt, near_norm, near_obj, px, py, 0, 1 });
+				tileBox.expand(near_pt);
+				tile.lastHit = near_obj;
+			}
+		}
+	}
+
+	tile.lights.clear();
+	if (tile.samples.size()) {
+		for (size_t l = 0; l < lights.size(); l++)
+			if (lights[l]->mayLight(tileBox, lightCutoff)) tile.lights.push_back(l);
+	}
+
+	for (size_t k = 0; k < tile.samples.size(); k++) {
+		const Tile::Sample &s = tile.samples[k];
+		size_t i = pixel(s.px, s.py);
+		tile.sampler.startPixel(s.px, s.py);
+		tile.forced = grow[i];
+		tile.sampled = tile.mixed = 0;
+		buffer.at(s.px - 1, s.py - 1) = shadePoint(Ray(s.p, s.d), s.pt, s.norm, s.obj, tile);
+		sampled[i] |= tile.sampled | grow[i];
+		penumbrae[i] |= tile.mixed;
+	}
+}
+
+
+//  ***
+//  anti-aliasing: the pixels that differ from a neighbour in the object hit, its normal
+//  or color get aaSamples subpixel rays, combined with the center ray through filter.
+//  All edges are found before any pixel changes, so the result does not depend on the
+//  order the tiles are refined in
+//
+bool RenderScene::antialiasPass(ThreadPool *pool, const std::atomic<bool> &cancel) {
+	vector<Tile> tiles(pool ? pool->size() : 1);
+
+	forTiles(pool, tiles, cancel, [&](int ti, int tj, Tile &) { findEdges(ti, tj); });
+	forTiles(pool, tiles, cancel, [&](int ti, int tj, Tile &tile) { antialiasTile(ti, tj, tile); });
+	if (cancel) return false;
+
+	for (size_t i = 0; i < tiles.size(); i++)
+		stats.add(tiles[i].stats);
+	return true;
+}
+
+
+//  ***
+//  marks the tile's pixels that differ from any of the 8 pixels around them
+//
+void RenderScene::findEdges(int ti, int tj) {
+	int width = buffer.getWidth(), height = buffer.getHeight();
+
+	for (int px = ti; px < ti + tileSize && px <= width; px++) {
+		for (int py = tj; py < tj + tileSize && py <= height; py++) {
+			size_t i = pixel(px, py);
+			bool found = false;
+
+			for (int y = std::max(py - 1, 1); y <= std::min(py + 1, height) && !found; y++)
+				for (int x = std::max(px - 1, 1); x <= std::min(px + 1, width) && !found; x++)
+					found = edge(px, py, x, y);
+			edges[i] = found;
+		}
+	}
+}
+
+
+//  ***
+//  true if pixels (px, py) and (x, y) see different objects, surfaces facing different
+//  ways or colors further apart than aaColor in any channel
+//  the colors are compared as they are displayed, clamped to 0..255: two pixels brighter
+//  than white look the same however far apart their floats are
+//
+bool RenderScene::edge(int px, int py, int x, int y) const {
+	size_t a = pixel(px, py), b = pixel(x, y);
+	if (hitObj[a] != hitObj[b]) return true;
+	if (hitObj[a] >= 0 && glm::dot(hitNorm[a], hitNorm[b]) < aaNormal) return true;
+
+	glm::vec3 ca = glm::clamp(buffer.at(px - 1, py - 1), glm::vec3(0), glm::vec3(255));
+	glm::vec3 cb = glm::clamp(buffer.at(x - 1, y - 1), glm::vec3(0), glm::vec3(255));
+	glm::vec3 d = glm::abs(ca - cb);
+	return d.x > aaColor || d.y > aaColor || d.z > aaColor;
+}
+
+
+//  ***
+//  refines the tile's pixels on an edge: the subpixel rays are spread evenly over the
+//  filter's support (a stratified 2D sequence of the pixel) and weighted by the filter,
+//  they are traced first and shaded with the lights that reach their hits like renderTile
+//
+void RenderScene::antialiasTile(int ti, int tj, Tile &tile) {
+	int width = buffer.getWidth(), height = buffer.getHeight();
+	float w_div = 1.0f / width, h_div = 1.0f / height;
+	glm::vec3 near_pt, near_norm;
+	int near_obj;
+	AABB tileBox;
+
+	tile.sampler.setup(samplePattern, seed);
+	tile.samples.clear();
+	tile.lastHit = -1;
+	tile.lastOccluder.assign(lights.size(), -1);
+	tile.filtered.assign(tileSize * tileSize, glm::vec4(0, 0, 0, 0));
+
+	for (int px = ti; px < ti + tileSize && px <= width; px++) {
+		for (int py = tj; py < tj + tileSize && py <= height; py++) {
+			if (!edges[pixel(px, py)]) continue;
+
+			//the center ray was traced by the passes
+			//
+			glm::vec4 &sum = tile.filtered[(px - ti) + (py - tj) * tileSize];
+			sum = glm::vec4(buffer.at(px - 1, py - 1), 1) * filter.weight(0, 0);
+			tile.stats.antialiased++;
+
+			tile.sampler.startPixel(px, py);
+			for (int s = 0; s < aaSamples; s++) {
+				glm::vec2 uv = tile.sampler.get2D(subpixelDim, s);
+				float dx = (2 * uv.x - 1) * filter.radius;
+				float dy = (2 * uv.y - 1) * filter.radius;
+				float weight = filter.weight(dx, dy);
+				if (weight == 0) continue;
+
+				Ray ray = renderCam.getRay(w_div * (px - 0.5f + dx), h_div * (py - 0.5f + dy));
+				tile.stats.subpixel++;
+
+				if (compiled.intersect(ray, near_pt, near_norm, near_obj, tile.lastHit)) {
+					tile.samples.push_back({ ray.p, ray.d, near_pt, near_norm, near_obj, px, py, s + 1, weight });
+					tileBox.expand(near_pt);
+					tile.lastHit = near_obj;
+				}
+				else
+					sum += glm::vec4(rgb(bkgndColor), 1) * weight;
+			}
+		}
+	}
+
+	tile.lights.clear();
+	if (tile.samples.size()) {
+		for (size_t l = 0; l < lights.size(); l++)
+			if (lights[l]->mayLight(tileBox, lightCutoff)) tile.lights.push_back(l);
+	}
+
+	//every subpixel ray has sample sequences of its own, and samples the area lights
+	//fully that have a penumbra at the pixel's center (not its sampled bits, which are
+	//all set where the center missed every object)
+	//
+	for (size_t k = 0; k < tile.samples.size(); k++) {
+		const Tile::Sample &s = tile.samples[k];
+		tile.sampler.startPixel(s.px, s.py, s.sub);
+		tile.forced = penumbrae[pixel(s.px, s.py)];
+		glm::vec3 c = shadePoint(Ray(s.p, s.d), s.pt, s.norm, s.obj, tile);
+		tile.filtered[(s.px - ti) + (s.py - tj) * tileSize] += glm::vec4(c, 1) * s.weight;
+	}
+
+	//the negative lobes of a filter can leave a weight of 0 or less, keep the center ray there
+	//
+	for (int px = ti; px < ti + tileSize && px <= width; px++) {
+		for (int py = tj; py < tj + tileSize && py <= height; py++) {
+			const glm::vec4 &sum = tile.filtered[(px - ti) + (py - tj) * tileSize];
+			if (sum.w > 0) buffer.at(px - 1, py - 1) = glm::vec3(sum) / sum.w;
+		}
+	}
+}
+
+
+//  ***
+//  renders the pass's pixels in the tile whose bottom left pixel is (ti, tj), pixels count from 1
+//  the tile is traced first, then shaded with only the lights that can reach its hit points
+//  runs on the render threads, so it only changes tile and the tile's own pixels
+//
+void RenderScene::renderTile(int ti, int tj, int step, bool first, Tile &tile) {
+	float width, height, w_div, h_div, w, h;
+	glm::vec3 near_pt, near_norm;
+	bool hit;
+	int near_obj;
+	AABB tileBox;
+
+	width = renderCam.view.width();
+	height = renderCam.view.height();
+	w_div = 1 / width;
+	h_div = 1 / height;
+
+	//the caches start empty in every tile
+	//
+	tile.sampler.setup(samplePattern, seed);
+	tile.samples.clear();
+	tile.lastHit = -1;
+	tile.lastOccluder.assign(lights.size(), -1);
+	tile.forced = 0;
+
+	//start at bottom left, on the pass's grid of every step-th pixel
+	//trace PACKET_W x PACKET_H neighbouring pixels of the grid at a time
+	//
+	int i1 = ti + (step - (ti - 1) % step) % step;
+	int j1 = tj + (step - (tj - 1) % step) % step;
+
+	for (int i0 = i1; i0 < ti + tileSize && i0 <= width; i0 += PACKET_W * step) {
+		for (int j0 = j1; j0 < tj + tileSize && j0 <= height; j0 += PACKET_H * step) {
+			// get the rays at the pixels' centers from the camera
+			//
+			RayPacket packet;
+			PacketHit packetHit;
+			int px[SIMD_WIDTH], py[SIMD_WIDTH];
+
+			for (int k = 0; k < SIMD_WIDTH; k++) {
+				px[k] = i0 + (k % PACKET_W) * step;
+				py[k] = j0 + (k / PACKET_W) * step;
+				if (px[k] > width || py[k] > height || px[k] >= ti + tileSize || py[k] >= tj + tileSize) continue;
+
+				//already traced by the coarser pass
+				if (!first && (px[k] - 1) % (2 * step) == 0 && (py[k] - 1) % (2 * step) == 0) continue;
+
+				w = w_div * px[k] - w_div / 2;
+				h = h_div * py[k] - h_div / 2;
+				Ray ray = renderCam.getRay(w, h);
+				packet.set(k, ray.p, ray.d);
+			}
+
+			// find the nearest object of every ray in the compiled scene
+			// starting with the object hit by the previous rays
+			//
+			if (bPackets)
+				compiled.intersectPacket(packet, packetHit, tile.lastHit);
+
+			for (int k = 0; k < SIMD_WIDTH; k++) {
+				if (!(packet.active & (1 << k))) continue;
+
+				Ray ray = Ray(packet.origin(k), packet.direction(k));
+
+				if (bPackets) {
+					near_obj = packetHit.obj[k];
+					hit = (near_obj >= 0);
+					near_pt = ray.evalPoint(packetHit.t[k]);
+					near_norm = packetHit.normal(k);
+				}
+				else
+					hit = compiled.intersect(ray, near_pt, near_norm, near_obj, tile.lastHit);
+
+				//object intersected with the view ray, shade it once the tile's lights are known
+				//otherwise set to background color
+				//
+				size_t i = pixel(px[k], py[k]);
+				hitObj[i] = hit ? near_obj : -1;
+
+				if (hit) {
+					hitNorm[i] = glm::normalize(near_norm);
+					tile.samples.push_back({ ray.p, ray.d, near_pt, near_norm, near_obj, px[k], py[k], 0, 1 });
+					tileBox.expand(near_pt);
+
+					tile.stats.primary++;
+					if (near_obj == tile.lastHit) tile.stats.primaryCached++;
+					else if (!bPackets) tile.lastHit = near_obj;
+				}
+				else {
+					buffer.at(px[k] - 1, py[k] - 1) = rgb(bkgndColor);
+					sampled[i] = ~0u;
+				}
+			}
+
+			//the next packet is seeded with the first object this one hit that was not cached
+			//
+			if (bPackets) {
+				for (int k = 0; k < SIMD_WIDTH; k++) {
+					if (packetHit.obj[k] >= 0 && packetHit.obj[k] != tile.lastHit) {
+						tile.lastHit = packetHit.obj[k];
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	//lights whose influence radius (and cone) reach the tile's hit points
+	//
+	tile.lights.clear();
+	if (tile.samples.size()) {
+		for (size_t l = 0; l < lights.size(); l++)
+			if (lights[l]->mayLight(tileBox, lightCutoff)) tile.lights.push_back(l);
+	}
+
+	//the sample points depend only on the pixel
+	//
+	for (size_t k = 0; k < tile.samples.size(); k++) {
+		const Tile::Sample &s = tile.samples[k];
+		size_t i = pixel(s.px, s.py);
+		tile.sampler.startPixel(s.px, s.py);
+		tile.sampled = tile.mixed = 0;
+		buffer.at(s.px - 1, s.py - 1) = shadePoint(Ray(s.p, s.d), s.pt, s.norm, s.obj, tile);
+		sampled[i] = tile.sampled;
+		penumbrae[i] = tile.mixed;
+	}
+}
+
+
+//  ***
+//  shading of the nearest hit of a camera ray
+//  ambient light plus phong shading of every light that is not blocked
+//
+glm::vec3 RenderScene::shadePoint(const Ray &ray, const glm::vec3 &near_pt, const glm::vec3 &near_norm, int near_obj,
+						  Tile &tile) {
+	glm::vec3 shade;
+
+	//default shading with ambient lighting
+	shade = rgb(scene[near_obj]->diffuseColor) * rgb(ambientColor) / 255.0f;
+
+	//the lights that can reach this point: the tile's lights hold every light that can
+	//reach its points, so the list does not depend on the tile or the pass
+	//(no shadow rays for lights that are too far or whose cone misses the point)
+	//
+	tile.reach.clear();
+	for (size_t k = 0; k < tile.lights.size(); k++)
+		if (lights[tile.lights[k]]->mayLight(near_pt, lightCutoff)) tile.reach.push_back(tile.lights[k]);
+
+	//many-light mode: a fixed budget of lights drawn from the light tree, each weighted
+	//by 1 / pdf so the average matches the sum over all lights (area lights use one
+	//sample point per draw). points reached by no more lights than the budget are shaded exactly
+	//
+	if (bManyLights && (int)tile.reach.size() > lightBudget) {
+		glm::vec3 sum = glm::vec3(0, 0, 0);
+		float pdf;
+
+		for (int s = 0; s < lightBudget; s++) {
+			int l = lightTree.sample(near_pt, tile.sampler.get1D(selectDim, s), pdf);
+			if (l < 0) continue;
+
+			int n = (lights[l]->type == 2) ? s : -1;
+			sum += shadeLight(ray, near_pt, near_norm, near_obj, l, n, tile) / pdf;
+		}
+
+		return shade + sum / float(lightBudget);
+	}
+
+	//for every light that can reach this point
+	//
+	for (size_t k = 0; k < tile.reach.size(); k++)
+		shade += shadeLight(ray, near_pt, near_norm, near_obj, tile.reach[k], -1, tile);
+
+	return shade;
+}
+
+
+//  ***
+//  phong shading of light l at near_pt, 0 where it is blocked
+//  area lights scale the shading by the fraction of the pixel's sample points on
+//  them that are visible, only point n when n >= 0
+//  adaptive sampling first tries the light's 4 corners and shadowBatch sample points:
+//  a point that sees all of them or none is taken to be fully lit or in the umbra,
+//  only a point where they disagree is in a penumbra and gets N * penumbraScale points,
+//  and so do the lights in tile.forced (see penumbraPass)
+//  a light with no more than minAdaptiveSamples points is cheaper to sample fully than
+//  to probe, and the batch never takes more points than the light has; neither is a light
+//  without a bit in the masks (penumbraBit)
+//
+glm::vec3 RenderScene::shadeLight(const Ray &ray, const glm::vec3 &near_pt, const glm::vec3 &near_norm, int near_obj,
+							int l, int n, Tile &tile) {
+	bool shadow;
+
+	//area light, soft shadows
+	//
+	if (lights[l]->type == 2) {
+		int first = (n >= 0) ? n : 0;
+		int last = (n >= 0) ? n + 1 : lights[l]->N;
+		bool adaptive = (n < 0 && bAdaptiveShadows && penumbraBit[l]);
+		int lit = 4;
+
+		//to determine if a shadow is cast on near_obj, check if a shadow ray hits any other object before the point (u, v) of the light
+		//
+		auto blocked = [&](float u, float v) {
+			glm::vec3 pt = lights[l]->area.samplePoint(u, v);
+			Ray shadow_ray = Ray(near_pt, glm::normalize(pt - near_pt));
+			return occluded(shadow_ray, glm::distance(pt, near_pt), near_obj, l, tile);
+		};
+
+		//number of sample points from..to-1 that are visible
+		//
+		auto visibleSamples = [&](int from, int to) {
+			int count = 0;
+			for (int i = from; i < to; i++) {
+				glm::vec2 uv = tile.sampler.get2D(areaDim(l), i);
+				if (!blocked(uv.x, uv.y)) count++;
+			}
+			return count;
+		};
+
+		if (adaptive) {
+			lit = !blocked(0, 0) + !blocked(1, 0) + !blocked(0, 1) + !blocked(1, 1);
+			last = std::min(shadowBatch, lights[l]->N);
+		}
+		int visible = visibleSamples(first, last);
+
+		if (adaptive) {
+			uint32_t bit = penumbraBit[l];
+			bool agree = (lit == 4 && visible == last) || (lit == 0 && visible == 0);
+
+			if (!agree || (tile.forced & bit)) {
+				int cap = std::max(int(lights[l]->N * penumbraScale), last);
+				visible += visibleSamples(last, cap);
+				last = cap;
+				tile.stats.penumbra++;
+
+				tile.sampled |= bit;
+				if (!agree || (visible != 0 && visible != last)) tile.mixed |= bit;
+			}
+			else if (visible) visible = last = 1;
+		}
+		if (!visible) return glm::vec3(0, 0, 0);
+
+		//the phong shading is the same for every point on the light, only the visibility differs
+		//
+		return phong(near_pt, ray.d, near_norm, l, scene[near_obj]->diffuseColor, scene[near_obj]->specularColor) *
+			   (float(visible) / (last - first));
+	}
+
+	//point or spot light, hard shadows only
+	//create ray from the nearest point of intersection from the raytrace to the light's position
+	//
+	Ray shadow_ray = Ray(near_pt, glm::normalize(lights[l]->worldPosition() - near_pt));
+
+	//to determine if a shadow is cast on near_obj, check if shadow_ray hits any other object before the light
+	shadow = occluded(shadow_ray, glm::distance(lights[l]->worldPosition(), near_pt), near_obj, l, tile);
+	if (shadow) return glm::vec3(0, 0, 0);
+
+	//no shadow detected, calculate phong shading
+	//(spotlights were already checked to cover the point by mayLight)
+	//
+	return phong(near_pt, ray.d, near_norm, l, scene[near_obj]->diffuseColor, scene[near_obj]->specularColor);
+}
+
+
+//  ***
+//  shadow ray test that tries the light's cached occluder before the compiled scene
+//  and remembers whichever object its tree finds blocking the ray
+//
+bool RenderScene::occluded(const Ray &ray, float tMax, int near_obj, int l, Tile &tile) {
+	int &lastOccluder = tile.lastOccluder[l];
+	tile.stats.shadow++;
+
+	if (lastOccluder >= 0 && lastOccluder != near_obj &&
+		compiled.occludedBy(lastOccluder, ray, tMax)) {
+		tile.stats.shadowBlocked++;
+		tile.stats.shadowCached++;
+		return true;
+	}
+
+	bool blocked = compiled.occluded(ray, tMax, near_obj, &lastOccluder);
+	if (blocked) tile.stats.shadowBlocked++;
+	return blocked;
 }
 
 
 //  ***
 //  Lambert Shading function
-//  calculates diffuse shading
+//  calculates diffuse shading of the point p
+//  the falloff and the direction to the light are measured from p. They used to be
+//  measured from the world origin (the view direction was passed in as the point), so a
+//  light was as bright far from a surface as next to it; culling lights by distance
+//  (Light::mayLight) is only exact because intensity / r^2 is taken at p
 //
-ofColor ofApp::lambert(const glm::vec3 &p, const glm::vec3 &norm, int i, const ofColor diffuse) {
+glm::vec3 RenderScene::lambert(const glm::vec3 &p, const glm::vec3 &norm, int i, const ofColor diffuse) {
 	
 	float r, I, dot_prod;
 
-	r = glm::distance(p, lights[i]->getPosition());
+	r = glm::distance(p, lights[i]->worldPosition());
 	I = lights[i]->intensity / (r * r);
-	dot_prod = std::max(0.0f, glm::dot(glm::normalize(norm), glm::normalize(lights[i]->getPosition())));
+	dot_prod = std::max(0.0f, glm::dot(glm::normalize(norm), glm::normalize(lights[i]->worldPosition() - p)));
 	
 	//calculate the shading of the diffuse color
-	ofColor shade = diffuse * (I * dot_prod) * lights[i]->diffuseColor;
+	glm::vec3 shade = rgb(diffuse) * (I * dot_prod) * rgb(lights[i]->diffuseColor) / 255.0f;
 
 	return shade;
 }
@@ -247,17 +1104,18 @@ ofColor ofApp::lambert(const glm::vec3 &p, const glm::vec3 &norm, int i, const o
 //  ***
 //  Blinn-Phong Shading function
 //  calculates specular and diffuse shading (uses lambert)
+//  the light is reflected about norm from p, like the falloff in lambert
 //
-ofColor ofApp::phong(/*const glm::vec3 &p,*/ const glm::vec3 &v, const glm::vec3 &norm, int i, const ofColor diffuse, const ofColor specular/*, float power*/) {
+glm::vec3 RenderScene::phong(const glm::vec3 &p, const glm::vec3 &v, const glm::vec3 &norm, int i, const ofColor diffuse, const ofColor specular/*, float power*/) {
 	
-	glm::vec3 refl = glm::reflect(glm::normalize(lights[i]->getPosition()), glm::normalize(norm));
+	glm::vec3 refl = glm::reflect(glm::normalize(lights[i]->worldPosition() - p), glm::normalize(norm));
 	float pw = glm::pow(std::max(0.0f, glm::dot(refl, glm::normalize(v))), lights[i]->power);
-	float r = glm::distance(v, glm::vec3(lights[i]->getPosition()));
+	float r = glm::distance(p, glm::vec3(lights[i]->worldPosition()));
 	float I = lights[i]->intensity / (r * r);
 	
 	//calculate the shading of the specular & diffuse colors combined
-	ofColor shine = specular * I * pw * lights[i]->diffuseColor;	
-	ofColor shade = lambert(v, norm, i, diffuse);
+	glm::vec3 shine = rgb(specular) * (I * pw) * rgb(lights[i]->diffuseColor) / 255.0f;
+	glm::vec3 shade = lambert(p, norm, i, diffuse);
 
 	return (shine + shade);
 }
\ No newline at end of file
@@ -0,0 +1,210 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#pragma once
+
+#include "ofMain.h"
+#include "Primitives.h"
+#include "compiledscene.h"
+#include "threadpool.h"
+#include "sampler.h"
+#include "filter.h"
+#include "framebuffer.h"
+#include <atomic>
+
+class ofApp;
+
+
+//  ***
+//  Snapshot of everything a render reads, taken on the main thread when the render starts
+//  The objects are clones (with parents pointing to the cloned parents and their own
+//  copies of the keyframes), the render camera and the settings are copies, so the scene
+//  can be edited while the render threads trace the snapshot. Nothing here is changed
+//  by the UI after construction. The raytracing functions are defined in raytrace.cpp,
+//  the transfer to render worker processes in distributed.cpp.
+//
+class RenderScene {
+public:
+	// // // VARIABLES // // //
+
+	// ***
+	// counters of a render
+	//
+	struct Stats {
+		long primary = 0, primaryCached = 0;	// camera ray hits, and those on the cached object
+		long shadow = 0, shadowBlocked = 0;		// shadow rays, and those that found an occluder
+		long shadowCached = 0;					// blocked by the cached occluder
+		long steals = 0;						// tiles taken over by another render thread
+		long penumbra = 0;						// area light shadings refined as penumbrae
+		long antialiased = 0, subpixel = 0;		// pixels refined by the anti-aliasing pass, and their extra rays
+
+		void add(const Stats &s) {
+			primary += s.primary;
+			primaryCached += s.primaryCached;
+			shadow += s.shadow;
+			shadowBlocked += s.shadowBlocked;
+			shadowCached += s.shadowCached;
+			penumbra += s.penumbra;
+			antialiased += s.antialiased;
+			subpixel += s.subpixel;
+		}
+	};
+
+	// ***
+	// state kept while a tile is rendered, one per render thread: the hit points
+	// waiting to be shaded, the lights that reach the tile, the sampler and the coherence
+	// caches, neighbouring pixels mostly hit the same object and are shadowed by the same
+	// occluder, so those are tested first
+	//
+	struct Tile {
+		struct Sample { glm::vec3 p, d, pt, norm; int obj, px, py, sub; float weight; };
+		vector<Sample> samples;
+		vector<int> lights;
+		vector<int> reach;			// those that pass mayLight at the point being shaded
+		int lastHit = -1;			// object hit by the previous camera rays
+		vector<int> lastOccluder;	// per light, last object found blocking a shadow ray
+		Sampler sampler;			// started at every shaded pixel
+		uint32_t forced = 0;		// bits (penumbraBit) of the area lights the pixel being shaded samples fully,
+		uint32_t sampled = 0;		// those it did sample fully
+		uint32_t mixed = 0;			// and those found to have a penumbra there (see penumbraPass)
+		vector<glm::vec4> filtered;	// per pixel of the tile, weighted color sum and weight of its subpixel rays
+		Stats stats;				// summed over the thread's tiles
+	};
+
+	// sample sequences: dimension 0 picks lights in many-light mode, dimension 1 places
+	// the subpixel rays, dimension 2 + l holds the points on area light l
+	//
+	static const int selectDim = 0, subpixelDim = 1;
+	static int areaDim(int l) { return 2 + l; }
+
+	// area lights with this many points or fewer are always sampled fully, the corner
+	// probe and first batch of adaptive sampling would trace about as many rays
+	//
+	static const int minAdaptiveSamples = 8;
+
+	// scene
+	//
+	vector<SceneObject *> scene;	// clones, in the order of ofApp::scene
+	vector<Light *> lights;			// clones of ofApp::lights
+	RenderCam renderCam;
+	CompiledScene compiled;
+	LightBVH lightTree;
+
+	// settings, copied from ofApp
+	//
+	ofColor ambientColor, bkgndColor;
+	int tileSize;
+	float lightCutoff;
+	int lightBudget;
+	bool bManyLights, bPackets;
+	bool bAdaptiveShadows;
+	int shadowBatch;
+	float penumbraScale;
+	Sampler::Pattern samplePattern;
+	bool bAntialias;
+	int aaSamples;
+	float aaColor, aaNormal;
+	PixelFilter filter;
+	uint32_t seed;					// of the sample sequences, the frame number for animation frames
+
+	// output
+	//
+	FrameBuffer buffer;		// linear colors, tonemapped into an image by fillBlocks
+	Stats stats;
+
+	// per pixel, stored like buffer (see pixel()): bits of the area lights sampled fully
+	// and of those with a penumbra there, filled in by the passes
+	//
+	vector<uint32_t> sampled, penumbrae;
+	vector<uint32_t> penumbraBit;	// per light, its bit in those masks, 0 for lights sampled fully
+
+	// per pixel: object a camera ray hit (-1 for none), its normal, and whether the
+	// anti-aliasing pass refines it
+	//
+	vector<int> hitObj;
+	vector<glm::vec3> hitNorm;
+	vector<uint8_t> edges;
+
+	// // // FUNCTIONS // // //
+
+	RenderScene(const vector<SceneObject *> &scene, const vector<Light *> &lights, const ofApp &app);
+	~RenderScene();
+
+	// snapshot of the animation frame of base's keyframes, base must outlive it
+	// (reads base only, so frames can be built on the render threads)
+	//
+	RenderScene(const RenderScene &base, int frame);
+
+	// the snapshot as bytes for the render workers, and back (NULL if data is not one)
+	//
+	string serialize() const;
+	static shared_ptr<RenderScene> deserialize(const string &data);
+
+	// compile the scene and build the acceleration structures, the expensive part of starting a render
+	// (safe to call from the render thread)
+	//
+	void prepare();
+
+	// trace the pixels on the grid of every step-th pixel into pixels, skipping those on the
+	// grid of the previous (coarser) pass unless first is set; returns false if cancelled
+	//
+	bool renderPass(ThreadPool &pool, int step, bool first, const std::atomic<bool> &cancel);
+
+	// trace every pixel on the calling thread, for frames rendered in parallel with each other
+	//
+	bool renderFrame(const std::atomic<bool> &cancel);
+
+	// adaptive area light sampling: once every pixel is traced, the pixels next to a
+	// penumbra are shaded again with the lights that have it sampled fully, until the
+	// penumbrae stop growing; on the pool or the calling thread (pool NULL), returns
+	// false if cancelled
+	//
+	bool penumbraPass(ThreadPool *pool, const std::atomic<bool> &cancel);
+
+	// anti-aliasing: once the penumbrae are done, the pixels on edges get subpixel rays
+	// (see bAntialias); on the pool or the calling thread (pool NULL), returns false if cancelled
+	//
+	bool antialiasPass(ThreadPool *pool, const std::atomic<bool> &cancel);
+
+	// the tonemapped frame, with every traced pixel of a step pass repeated over the
+	// step x step block it stands for (step 1 for the finished image)
+	//
+	void fillBlocks(int step, ofPixels &out) const;
+
+private:
+	// // // VARIABLES // // //
+
+	vector<int> tileOrder;		// tasks of a pass to tiles (column * tilesY + row), in Morton order
+
+	// // // FUNCTIONS // // //
+
+	RenderScene() {}
+
+	// where pixel (px, py), counted from 1 like the tiles, is in the per pixel arrays
+	//
+	size_t pixel(int px, int py) const { return buffer.index(px - 1, py - 1); }
+
+	void cloneScene(const vector<SceneObject *> &objs, const vector<Light *> &ls);
+	void renderTile(int ti, int tj, int step, bool first, Tile &tile);
+	glm::vec3 shadePoint(const Ray &ray, const glm::vec3 &near_pt, const glm::vec3 &near_norm, int near_obj, Tile &tile);
+	glm::vec3 shadeLight(const Ray &ray, const glm::vec3 &near_pt, const glm::vec3 &near_norm, int near_obj,
+						 int l, int n, Tile &tile);
+	bool occluded(const Ray &ray, float tMax, int near_obj, int l, Tile &tile);
+	void forTiles(ThreadPool *pool, vector<Tile> &tiles, const std::atomic<bool> &cancel,
+				  const std::function<void(int ti, int tj, Tile &tile)> &f);
+	void growPenumbrae(int ti, int tj, vector<uint32_t> &grow) const;
+	void refineTile(int ti, int tj, const vector<uint32_t> &grow, Tile &tile);
+	void findEdges(int ti, int tj);
+	bool edge(int px, int py, int x, int y) const;
+	void antialiasTile(int ti, int tj, Tile &tile);
+	glm::vec3 lambert(const glm::vec3 &p, const glm::vec3 &norm,
+					int i, const ofColor diffuse);
+	glm::vec3 phong(const glm::vec3 &p, const glm::vec3 &v, const glm::vec3 &norm,
+					int i,	const ofColor diffuse, const ofColor specular);
+
+	static glm::vec3 rgb(const ofColor &c) { return glm::vec3(c.r, c.g, c.b); }
+};
@@ -0,0 +1,135 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#pragma once
+
+#include "ofMain.h"
+#include <stdint.h>
+
+//  ***
+//  Sample points for the render threads, one Sampler per thread (see RenderScene::Tile)
+//  Every pixel gets its own sequences, numbered by dimension: get2D(d, i) is point i of
+//  the pixel's sequence d. Any number of dimensions and points can be drawn, so there
+//  is no limit on lights or samples per light. The points are a function of the render
+//  seed, the pixel, d and i only, which keeps renders repeatable whatever thread or order
+//  the pixels are shaded in.
+//
+//  The points are the first two Sobol dimensions, Owen scrambled with a hash
+//  (Burley, "Practical Hash-based Owen Scrambling", 2020): the first N points of a
+//  sequence stay stratified like the plain Sobol points, but each pixel and dimension
+//  has its own scramble so neighbouring pixels are uncorrelated.
+//  BLUE_NOISE scrambles by dimension only and shifts each pixel's points by interleaved
+//  gradient noise instead, which spreads the error between neighbouring pixels as
+//  blue noise (less visible at low sample counts, but it can show a faint pattern).
+//
+class Sampler {
+public:
+	enum Pattern { SOBOL, BLUE_NOISE };
+
+	// // // FUNCTIONS // // //
+
+	void setup(Pattern p, uint32_t s) {
+		pattern = p;
+		seed = hash(s);
+	}
+
+	// sub numbers the subpixel rays of an anti-aliased pixel, each has its own sequences
+	//
+	void startPixel(int x, int y, uint32_t sub = 0) {
+		px = x;
+		py = y;
+		subpixel = sub;
+		pixel = hash(seed ^ hash(uint32_t(x) * 0x8da6b343u ^ uint32_t(y) * 0xd8163841u));
+		if (sub) pixel = hash(pixel + sub);
+	}
+
+	glm::vec2 get2D(uint32_t dim, uint32_t index) const {
+		if (pattern == BLUE_NOISE) {
+			uint32_t s = hash(seed + dim + subpixel * 0x9e3779b9u);
+			glm::vec2 p = sobolOwen(index, s);
+			p.x += gradientNoise(px + 5.0f * dim, py);
+			p.y += gradientNoise(px, py + 7.0f * dim);
+			return glm::vec2(wrap(p.x), wrap(p.y));
+		}
+		return sobolOwen(index, hash(pixel + dim));
+	}
+
+	float get1D(uint32_t dim, uint32_t index) const {
+		return get2D(dim, index).x;
+	}
+
+private:
+	// // // VARIABLES // // //
+
+	Pattern pattern = SOBOL;
+	uint32_t seed = 0, pixel = 0, subpixel = 0;
+	int px = 0, py = 0;
+
+	// // // FUNCTIONS // // //
+
+	static uint32_t hash(uint32_t x) {
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	static uint32_t reverseBits(uint32_t x) {
+		x = (x << 16) | (x >> 16);
+		x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+		x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+		x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+		x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+		return x;
+	}
+
+	// Laine-Karras permutation: each bit is flipped by a hash of the bits below it,
+	// applied to reversed bits that is a nested uniform (Owen) scramble
+	//
+	static uint32_t owenScramble(uint32_t x, uint32_t s) {
+		x = reverseBits(x);
+		x += s;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return reverseBits(x);
+	}
+
+	// second Sobol dimension, the first is reverseBits(index)
+	//
+	static uint32_t sobol1(uint32_t index) {
+		uint32_t v = 1u << 31, r = 0;
+		for (; index; index >>= 1, v ^= v >> 1)
+			if (index & 1) r ^= v;
+		return r;
+	}
+
+	// the index is scrambled too, so the points of different pixels come in different orders
+	//
+	static glm::vec2 sobolOwen(uint32_t index, uint32_t s) {
+		uint32_t i = owenScramble(index, s);
+		uint32_t x = owenScramble(reverseBits(i), hash(s ^ 0x5bd1e995u));
+		uint32_t y = owenScramble(sobol1(i), hash(s ^ 0x27d4eb2fu));
+		return glm::vec2(toFloat(x), toFloat(y));
+	}
+
+	static float toFloat(uint32_t x) {
+		return (x >> 8) * (1.0f / 16777216.0f);
+	}
+
+	static float gradientNoise(float x, float y) {
+		return wrap(52.9829189f * wrap(0.06711056f * x + 0.00583715f * y));
+	}
+
+	static float wrap(float x) {
+		x -= floorf(x);
+		return x < 1 ? x : 0;
+	}
+};
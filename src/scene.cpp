@@ -27,11 +27,13 @@ void ofApp::newObj(char key) {
 		o = new Sphere(p);
 		o->name = "Sphere" + to_string(numObj);
 		break;
-	case 'm':									// load default star mesh		
-		model.loadModel("star.obj");			// inside ~/bin/data/
-		o = new Mesh(model.getMesh(0), p);
+	case 'm': {									// load default star mesh
+		vector<shared_ptr<MeshGeometry>> &meshes = loadGeometry("star.obj");	// inside ~/bin/data/
+		if (meshes.empty()) return;
+		o = new Mesh(meshes[0], p);
 		o->name = "Mesh" + to_string(numObj);
 		break;
+	}
 	case 'l':									// light
 		lights.push_back(new Light(p));			// push onto lights vector
 		o = lights[lights.size() - 1];
@@ -42,25 +44,111 @@ void ofApp::newObj(char key) {
 	// initialize keyframe 0
 	// all objects have at least this keyframe
 	//
-	o->frames[0] = new Keyframe(0, 0, p, glm::vec3(0), glm::vec3(1), glm::vec3(0));
-	o->frmExist[0] = true;
+	o->keys.insert(new Keyframe(0, 0, p, glm::vec3(0), glm::vec3(1), glm::vec3(0)));
 
 	// add this object to the parent's childList
 	//
 	if (objSelected()) {
-		o->position = glm::inverse(selected[0]->getMatrix()) * glm::vec4(p, 1);
+		o->position = selected[0]->getInverseMatrix() * glm::vec4(p, 1);
 		selected[0]->addChild(o);
 	}
 
 	// push onto vectors
 	//
 	scene.push_back(o);
-	recentKF.push_back(0);
-	nextKF.push_back(0);
 	numObj++;
 }
 
 
+//  ***
+//  geometry of every mesh in a model file
+//  the file is only loaded the first time, later calls return the same
+//  geometry so all instances of a model share one copy of the triangles
+//  MeshLoader reads a model as one mesh, the list is empty if it cannot be read
+//
+vector<shared_ptr<MeshGeometry>> &ofApp::loadGeometry(const string &file) {
+	vector<shared_ptr<MeshGeometry>> &meshes = geometry[file];
+	if (meshes.size()) return meshes;
+
+	MeshLoader loader;
+	shared_ptr<MeshGeometry> g = make_shared<MeshGeometry>();
+	if (!loader.load(file, g->mesh)) {
+		std::cout << "cannot load " << file << ": " << loader.error() << endl;
+		return meshes;
+	}
+
+	// the loader's vertices are already welded
+	//
+	float start = ofGetElapsedTimef();
+	g->welded = true;
+	g->build(meshLayout);
+	float bvhTime = ofGetElapsedTimef() - start;
+	meshes.push_back(g);
+
+	// the BVH is built next to the loaded mesh, whichever held more is the peak
+	//
+	const MeshLoader::Stats &s = loader.stats();
+	size_t meshBytes = g->mesh.getVertices().size() * sizeof(glm::vec3) + g->mesh.getIndices().size() * sizeof(ofIndexType) +
+					   g->mesh.getNormals().size() * sizeof(glm::vec3);
+	size_t peak = std::max(s.peakBytes, meshBytes + g->bvh.buildBytes);
+	std::cout << "loaded " << file << ": " << s.triangles << " triangles, " << s.vertices << " vertices";
+	if (s.skipped) std::cout << ", " << s.skipped << " bad faces skipped";
+	std::cout << endl << "  " << s.fileBytes / 1048576.0 << " MB read in " << s.read << " s, parsed in " << s.parse
+			  << " s on " << s.threads << " threads, welded in " << s.weld << " s, normals in " << s.normals
+			  << " s, BVH in " << bvhTime << " s, peak " << peak / 1048576.0 << " MB" << endl;
+	return meshes;
+}
+
+
+//  ***
+//  switch every mesh between the full and compact layouts and report the memory
+//  they take, so footprint and render time can be compared on the same scene
+//  refused while an animation renders, its frames keep the layout they started with
+//
+void ofApp::setMeshLayout(MeshBVH::Layout layout) {
+	pollRender();
+	if (renderFrames || bPlayRT) {
+		std::cout << "mesh layout: not while the animation renders" << endl;
+		return;
+	}
+
+	// the geometry is rebuilt in place and shared with the render's snapshot
+	//
+	bool rendering = renderThread.joinable();
+	cancelRender();
+	meshLayout = layout;
+
+	// geometry is shared, collect each one once
+	//
+	vector<MeshGeometry *> meshes;
+	for (auto it = geometry.begin(); it != geometry.end(); it++)
+		for (size_t i = 0; i < it->second.size(); i++) meshes.push_back(it->second[i].get());
+	for (size_t i = 0; i < scene.size(); i++) {
+		Mesh *m = dynamic_cast<Mesh *>(scene[i]);
+		if (m && std::find(meshes.begin(), meshes.end(), m->geometry.get()) == meshes.end())
+			meshes.push_back(m->geometry.get());
+	}
+
+	size_t bytes = 0;
+	int tris = 0;
+	for (MeshGeometry *g : meshes) {
+		g->build(layout);
+		bytes += g->bvh.memoryUsage();
+		tris += g->bvh.numTriangles;
+	}
+
+	// bounds can move slightly with quantization
+	//
+	sceneBVH.clear();
+
+	const char *names[] = { "full", "compact", "compact 16 bit" };
+	std::cout << "mesh layout: " << names[layout] << ", " << meshes.size() << " meshes, " << tris
+			  << " triangles, " << bytes / 1024.0 << " KB" << endl;
+
+	if (rendering) startRender(true, !renderFile.empty());
+}
+
+
 //  ***
 //  delete object and remove it from the scene
 //
@@ -74,7 +162,7 @@ void ofApp::delObj() {
 	if (parent != NULL) {
 		if (delSel->childList.size()) {
 			parent->addChild(delSel->childList[0]);
-			glm::mat4 m = delSel->getMatrix() * glm::inverse(parent->getMatrix());
+			glm::mat4 m = delSel->getMatrix() * parent->getInverseMatrix();
 
 			delSel->childList[0]->position = m * glm::vec4(delSel->childList[0]->position, 1);
 			delSel->childList[0]->rotation = m * glm::vec4(delSel->childList[0]->rotation, 1);
@@ -107,7 +195,7 @@ void ofApp::delObj() {
 			// has more children, make them the new root's children
 			//
 			if (delSel->childList.size() > 1) {
-				glm::mat4 m = delSel->getMatrix() * glm::inverse(parent->getMatrix());
+				glm::mat4 m = delSel->getMatrix() * parent->getInverseMatrix();
 				for (int i = 1; i < delSel->childList.size(); i++) {
 					delSel->childList[i]->position = m * glm::vec4(delSel->childList[i]->position, 1);
 					delSel->childList[i]->rotation = m * glm::vec4(delSel->childList[i]->rotation, 1);
@@ -120,21 +208,12 @@ void ofApp::delObj() {
 
 	// remove delSel from the scene
 	//
-	it = find(scene.begin(), scene.end(), delSel);
-	if (it != scene.end()) {
-		recentKF.erase(recentKF.begin() + (it - scene.begin()));
-		nextKF.erase(nextKF.begin() + (it - scene.begin()));
-		scene.erase(it);
-	}
+	scene.erase(delSel);
 
 	// object is a light, remove from light vector
 	// 
-	if (typeid(*delSel) == typeid(Light)) {
-		vector<Light*>::iterator l;
-		l = find(lights.begin(), lights.end(), delSel);
-		if (l != lights.end())
-			lights.erase(l);
-	}
+	if (typeid(*delSel) == typeid(Light))
+		lights.erase((Light *)delSel);
 
 	// clear selection & delete selected
 	//
@@ -147,7 +226,7 @@ void ofApp::delObj() {
 //  if the object selection has changed, update slider values
 //
 void ofApp::updateSliders() {
-	prevSelected = selected[0];	// to track if selection changes
+	prevSelected = selected[0]->handle;	// to track if selection changes
 
 	// color sliders
 	//
@@ -158,9 +237,9 @@ void ofApp::updateSliders() {
 	// animation sliders
 	//
 	if (bAnimate && !bPlayback) {
-		int i = recentKF[find(scene.begin(), scene.end(), selected[0]) - scene.begin()];
-		fnSld = selected[0]->frames[i]->function;
-		setFrmSldColor(selected[0]->frmExist[currFrm]);
+		Keyframe *key = selected[0]->keys.latest(currFrm);
+		if (key) fnSld = key->function;
+		setFrmSldColor(selected[0]->keys.find(currFrm) != NULL);
 	}
 
 	// light sliders
@@ -192,23 +271,22 @@ void ofApp::updateSelected(bool newFrm) {
 
 	// animation sliders
 	//
-	if (bAnimate && !bPlayback) {
-		int i = recentKF[find(scene.begin(), scene.end(), selected[0]) - scene.begin()];
-
+	Keyframe *key = selected[0]->keys.latest(currFrm);
+	if (bAnimate && !bPlayback && key) {
 		if (newFrm) {
-			fnSld = selected[0]->frames[i]->function;
-			setFrmSldColor(selected[0]->frmExist[currFrm]);
+			fnSld = key->function;
+			setFrmSldColor(key->frame == currFrm);
 		}
-		else if (selected[0]->position != selected[0]->frames[i]->position)
-			selected[0]->frames[i]->position = selected[0]->position;
-		else if (selected[0]->rotation != selected[0]->frames[i]->rotation)
-			selected[0]->frames[i]->rotation = selected[0]->rotation;
-		else if (selected[0]->scale != selected[0]->frames[i]->scale)
-			selected[0]->frames[i]->scale = selected[0]->scale;
-		//else if (selected[0]->pivot != selected[0]->frames[i]->pivot)
-			//selected[0]->frames[i]->pivot = selected[0]->pivot;
-		else if (fnSld != selected[0]->frames[i]->function)
-			selected[0]->frames[i]->function = fnSld;
+		else if (selected[0]->position != key->position)
+			key->position = selected[0]->position;
+		else if (selected[0]->rotation != key->rotation)
+			key->rotation = selected[0]->rotation;
+		else if (selected[0]->scale != key->scale)
+			key->scale = selected[0]->scale;
+		//else if (selected[0]->pivot != key->pivot)
+			//key->pivot = selected[0]->pivot;
+		else if (fnSld != key->function)
+			key->function = fnSld;
 	}
 
 	// light sliders
@@ -0,0 +1,200 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#pragma once
+
+//  ***
+//  Minimal SIMD float wrapper used by the packet tracing kernels
+//  The width is chosen at compile time:
+//		AVX				8 lanes (__m256)
+//		SSE2			4 lanes (__m128)
+//		anything else	4 lanes emulated with plain floats
+//  Comparisons return a vfloat with all bits set in the passing lanes,
+//  which is what select() and mask() expect.
+//
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_WIDTH 8
+#define SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_WIDTH 4
+#define SIMD_SSE
+#else
+#include <cmath>
+#include <cstring>
+#define SIMD_WIDTH 4
+#endif
+
+#if defined(_MSC_VER)
+#define SIMD_ALIGN __declspec(align(32))
+#else
+#define SIMD_ALIGN __attribute__((aligned(32)))
+#endif
+
+// bit mask with one bit per lane
+//
+const int SIMD_ALL = (1 << SIMD_WIDTH) - 1;
+
+
+//  ***
+//  vector allocator for structures with SIMD_ALIGN members (see TriangleBlock)
+//  Before C++17 operator new only promises the default alignment (8 or 16 bytes),
+//  the aligned AVX loads of vfloat::load need 32.
+//  Use as vector<T, SimdAllocator<T>>.
+//
+#if defined(_MSC_VER)
+#include <malloc.h>
+inline void *simdAlloc(size_t bytes) { return _aligned_malloc(bytes, 32); }
+inline void simdFree(void *p) { _aligned_free(p); }
+#else
+#include <stdlib.h>
+inline void *simdAlloc(size_t bytes) { void *p; return posix_memalign(&p, 32, bytes) ? NULL : p; }
+inline void simdFree(void *p) { free(p); }
+#endif
+#include <new>
+
+template <class T>
+struct SimdAllocator {
+	typedef T value_type;
+
+	SimdAllocator() {}
+	template <class U> SimdAllocator(const SimdAllocator<U> &) {}
+
+	T *allocate(size_t n) {
+		void *p = simdAlloc(n * sizeof(T));
+		if (!p) throw std::bad_alloc();
+		return (T *)p;
+	}
+	void deallocate(T *p, size_t) { simdFree(p); }
+
+	template <class U> bool operator==(const SimdAllocator<U> &) const { return true; }
+	template <class U> bool operator!=(const SimdAllocator<U> &) const { return false; }
+};
+
+
+#if defined(SIMD_AVX)
+
+struct vfloat {
+	__m256 v;
+
+	vfloat() {}
+	vfloat(__m256 x) : v(x) {}
+	vfloat(float x) : v(_mm256_set1_ps(x)) {}
+
+	static vfloat load(const float *p) { return _mm256_load_ps(p); }
+	void store(float *p) const { _mm256_store_ps(p, v); }
+
+	// lanes whose bit is set in bits are all ones, others zero
+	static vfloat lanes(int bits) {
+		// AVX1 has no 256 bit integer ops, so the bits go through floats
+		__m256 m = _mm256_setr_ps((float)(bits & 1), (float)(bits & 2), (float)(bits & 4), (float)(bits & 8),
+			(float)(bits & 16), (float)(bits & 32), (float)(bits & 64), (float)(bits & 128));
+		return _mm256_cmp_ps(m, _mm256_setzero_ps(), _CMP_NEQ_OQ);
+	}
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return _mm256_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm256_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm256_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm256_div_ps(a.v, b.v); }
+inline vfloat operator<(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline vfloat operator>(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline vfloat operator<=(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline vfloat operator>=(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline vfloat operator&(vfloat a, vfloat b) { return _mm256_and_ps(a.v, b.v); }
+inline vfloat operator|(vfloat a, vfloat b) { return _mm256_or_ps(a.v, b.v); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a.v, b.v); }
+inline vfloat vsqrt(vfloat a) { return _mm256_sqrt_ps(a.v); }
+inline vfloat vabs(vfloat a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+inline vfloat select(vfloat m, vfloat a, vfloat b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+inline int mask(vfloat m) { return _mm256_movemask_ps(m.v); }
+
+#elif defined(SIMD_SSE)
+
+struct vfloat {
+	__m128 v;
+
+	vfloat() {}
+	vfloat(__m128 x) : v(x) {}
+	vfloat(float x) : v(_mm_set1_ps(x)) {}
+
+	static vfloat load(const float *p) { return _mm_load_ps(p); }
+	void store(float *p) const { _mm_store_ps(p, v); }
+
+	static vfloat lanes(int bits) {
+		__m128i b = _mm_set1_epi32(bits);
+		__m128i sel = _mm_setr_epi32(1, 2, 4, 8);
+		return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(b, sel), sel));
+	}
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return _mm_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm_div_ps(a.v, b.v); }
+inline vfloat operator<(vfloat a, vfloat b) { return _mm_cmplt_ps(a.v, b.v); }
+inline vfloat operator>(vfloat a, vfloat b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline vfloat operator<=(vfloat a, vfloat b) { return _mm_cmple_ps(a.v, b.v); }
+inline vfloat operator>=(vfloat a, vfloat b) { return _mm_cmpge_ps(a.v, b.v); }
+inline vfloat operator&(vfloat a, vfloat b) { return _mm_and_ps(a.v, b.v); }
+inline vfloat operator|(vfloat a, vfloat b) { return _mm_or_ps(a.v, b.v); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a.v, b.v); }
+inline vfloat vsqrt(vfloat a) { return _mm_sqrt_ps(a.v); }
+inline vfloat vabs(vfloat a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+inline vfloat select(vfloat m, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+inline int mask(vfloat m) { return _mm_movemask_ps(m.v); }
+
+#else
+
+//  plain float fallback, masks are stored as 0 / 1 per lane
+//
+struct vfloat {
+	float v[SIMD_WIDTH];
+
+	vfloat() {}
+	vfloat(float x) { for (int i = 0; i < SIMD_WIDTH; i++) v[i] = x; }
+
+	static vfloat load(const float *p) { vfloat r; memcpy(r.v, p, sizeof(r.v)); return r; }
+	void store(float *p) const { memcpy(p, v, sizeof(v)); }
+
+	static vfloat lanes(int bits) {
+		vfloat r;
+		for (int i = 0; i < SIMD_WIDTH; i++) r.v[i] = (float)((bits >> i) & 1);
+		return r;
+	}
+};
+
+#define SIMD_BINARY(op, expr) \
+	inline vfloat op(vfloat a, vfloat b) { vfloat r; for (int i = 0; i < SIMD_WIDTH; i++) r.v[i] = (expr); return r; }
+
+SIMD_BINARY(operator+, a.v[i] + b.v[i])
+SIMD_BINARY(operator-, a.v[i] - b.v[i])
+SIMD_BINARY(operator*, a.v[i] * b.v[i])
+SIMD_BINARY(operator/, a.v[i] / b.v[i])
+SIMD_BINARY(operator<, (float)(a.v[i] < b.v[i]))
+SIMD_BINARY(operator>, (float)(a.v[i] > b.v[i]))
+SIMD_BINARY(operator<=, (float)(a.v[i] <= b.v[i]))
+SIMD_BINARY(operator>=, (float)(a.v[i] >= b.v[i]))
+SIMD_BINARY(operator&, (float)(a.v[i] != 0 && b.v[i] != 0))
+SIMD_BINARY(operator|, (float)(a.v[i] != 0 || b.v[i] != 0))
+SIMD_BINARY(vmin, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+SIMD_BINARY(vmax, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+
+#undef SIMD_BINARY
+
+inline vfloat vsqrt(vfloat a) { vfloat r; for (int i = 0; i < SIMD_WIDTH; i++) r.v[i] = sqrtf(a.v[i]); return r; }
+inline vfloat vabs(vfloat a) { vfloat r; for (int i = 0; i < SIMD_WIDTH; i++) r.v[i] = fabsf(a.v[i]); return r; }
+inline vfloat select(vfloat m, vfloat a, vfloat b) { vfloat r; for (int i = 0; i < SIMD_WIDTH; i++) r.v[i] = m.v[i] != 0 ? a.v[i] : b.v[i]; return r; }
+inline int mask(vfloat m) { int r = 0; for (int i = 0; i < SIMD_WIDTH; i++) r |= (m.v[i] != 0) << i; return r; }
+
+#endif
+
+inline vfloat operator-(vfloat a) { return vfloat(0.0f) - a; }
@@ -0,0 +1,125 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#include "threadpool.h"
+
+
+//  ***
+ThreadPool::ThreadPool(int threads) : steals(0) {
+	start(threads);
+}
+
+
+ThreadPool::~ThreadPool() {
+	stop();
+}
+
+
+void ThreadPool::resize(int threads) {
+	stop();
+	start(threads);
+}
+
+
+void ThreadPool::start(int threads) {
+	if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+	// new workers only wake up for jobs started after this point
+	//
+	quit = false;
+	for (int i = 0; i < threads; i++)
+		queues.push_back(std::unique_ptr<Queue>(new Queue()));
+	for (int i = 0; i < threads; i++)
+		workers.push_back(std::thread(&ThreadPool::run, this, i, generation));
+}
+
+
+void ThreadPool::stop() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+	queues.clear();
+}
+
+
+//  ***
+//  worker i gets tasks [i * count / n, (i + 1) * count / n), neighbouring tasks
+//  (tiles) stay on the same thread unless they are stolen
+//
+void ThreadPool::parallelFor(int count, const std::function<void(int, int)> &f) {
+	if (count <= 0) return;
+
+	int n = size();
+	for (int i = 0; i < n; i++) {
+		std::lock_guard<std::mutex> guard(queues[i]->lock);
+		for (int t = (int)((long)i * count / n); t < (int)((long)(i + 1) * count / n); t++)
+			queues[i]->tasks.push_back(t);
+	}
+
+	std::unique_lock<std::mutex> guard(lock);
+	job = &f;
+	steals = 0;
+	running = n;
+	generation++;
+	wake.notify_all();
+
+	done.wait(guard, [&] { return running == 0; });
+	job = nullptr;
+	numSteals = steals;
+}
+
+
+//  ***
+//  own queue first (front), then the other queues (back) starting with the next worker
+//
+bool ThreadPool::next(int id, int &task) {
+	int n = size();
+	for (int k = 0; k < n; k++) {
+		Queue &q = *queues[(id + k) % n];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (q.tasks.empty()) continue;
+
+		if (k == 0) {
+			task = q.tasks.front();
+			q.tasks.pop_front();
+		}
+		else {
+			task = q.tasks.back();
+			q.tasks.pop_back();
+			steals++;
+		}
+		return true;
+	}
+	return false;
+}
+
+
+void ThreadPool::run(int id, unsigned long seen) {
+	while (true) {
+		const std::function<void(int, int)> *f;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [&] { return quit || generation != seen; });
+			if (quit) return;
+			seen = generation;
+			f = job;
+		}
+
+		int task;
+		while (next(id, task))
+			(*f)(task, id);
+
+		std::lock_guard<std::mutex> guard(lock);
+		if (--running == 0) done.notify_all();
+	}
+}
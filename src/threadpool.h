@@ -0,0 +1,71 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+
+//  ***
+//  Persistent pool of worker threads with work stealing
+//  parallelFor() deals the tasks out to the workers in contiguous runs, each
+//  worker takes tasks from the front of its own queue and, once it is empty,
+//  steals from the back of another worker's queue, so a run of expensive tasks
+//  does not keep the other threads idle. The threads sleep between calls.
+//
+class ThreadPool {
+public:
+	// // // FUNCTIONS // // //
+
+	ThreadPool(int threads = 0);	// 0 = one per hardware thread
+	~ThreadPool();
+
+	// stop the workers and start new ones (0 = one per hardware thread)
+	//
+	void resize(int threads);
+	int size() const { return (int)workers.size(); }
+
+	// call f(task, worker) for every task in [0, count) and wait until all are done
+	// worker is in [0, size()), tasks run on the same worker never overlap
+	//
+	void parallelFor(int count, const std::function<void(int task, int worker)> &f);
+
+	long numSteals = 0;		// statistics, tasks taken from another worker's queue
+
+private:
+	// // // VARIABLES // // //
+
+	struct Queue {
+		std::mutex lock;
+		std::deque<int> tasks;
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<Queue>> queues;
+
+	std::mutex lock;
+	std::condition_variable wake, done;
+	const std::function<void(int, int)> *job = nullptr;
+	unsigned long generation = 0;	// bumped by every parallelFor, wakes the workers
+	int running = 0;				// workers still busy with the current job
+	std::atomic<long> steals;
+	bool quit = false;
+
+	// // // FUNCTIONS // // //
+
+	void start(int threads);
+	void stop();
+	void run(int id, unsigned long seen);
+	bool next(int id, int &task);
+};
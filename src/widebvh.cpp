@@ -0,0 +1,223 @@
+//
+//   Andie Sanchez
+//   2 February 2019
+
+
+//   ALL ORIGINAL CLASSES & FUNCTIONS WILL BE MARKED with " *** "
+
+//
+//  Compact layouts of MeshBVH
+//  The binary build tree is collapsed into 8 wide nodes whose child boxes are
+//  quantized to one byte per coordinate, and the triangles index the welded
+//  vertex buffer (optionally quantized to 16 bits). Tracing decodes on the fly,
+//  trading some speed for a much smaller footprint than the FULL layout.
+//
+
+#include "bvh.h"
+#include <cassert>
+
+
+// // // BUILD // // //
+
+
+//  ***
+//  snap every vertex to a 16 bit grid over the mesh bounds
+//  verts is replaced by the decoded positions so the tree bounds what is traced
+//
+void MeshBVH::quantize(vector<glm::vec3> &verts) {
+	AABB box;
+	for (size_t i = 0; i < verts.size(); i++) box.expand(verts[i]);
+
+	qOrigin = box.min;
+	qScale = (box.max - box.min) / 65535.0f;
+	qvertices.resize(3 * verts.size());
+
+	for (size_t i = 0; i < verts.size(); i++) {
+		for (int k = 0; k < 3; k++) {
+			float q = qScale[k] > 0 ? std::round((verts[i][k] - qOrigin[k]) / qScale[k]) : 0;
+			qvertices[3 * i + k] = (uint16_t)std::min(std::max(q, 0.0f), 65535.0f);
+		}
+		verts[i] = vertex(i);
+	}
+}
+
+
+//  ***
+//  collapse the build tree below b into a WideNode, returns its index in wnodes
+//  the largest inner child is opened until there are 8 children (or only leaves)
+//  leaf triangles are appended to tris in traversal order
+//
+int MeshBVH::collapse(const BuildNode *b, const vector<uint32_t> &tri) {
+	vector<const BuildNode *> kids;
+	if (b->left) {
+		kids.push_back(b->left.get());
+		kids.push_back(b->right.get());
+	}
+	else kids.push_back(b);		// the whole mesh is a single leaf
+
+	while (kids.size() < 8) {
+		int best = -1;
+		for (size_t i = 0; i < kids.size(); i++)
+			if (kids[i]->left && (best < 0 || kids[i]->box.surfaceArea() > kids[best]->box.surfaceArea()))
+				best = i;
+		if (best < 0) break;
+
+		const BuildNode *open = kids[best];
+		kids[best] = open->left.get();
+		kids.push_back(open->right.get());
+	}
+
+	int n = wnodes.size();
+	wnodes.push_back(WideNode());
+
+	// quantization grid of this node, the exponent leaves one step of headroom
+	// so the rounded up maximum always fits in a byte
+	//
+	WideNode w;
+	float step[3];
+	w.origin = b->box.min;
+	for (int k = 0; k < 3; k++) {
+		float extent = b->box.max[k] - b->box.min[k];
+		int e = extent > 0 ? (int)std::ceil(std::log2(extent / 254.0f)) : -126;
+		w.exponent[k] = (int8_t)std::min(std::max(e, -126), 127);
+		step[k] = std::ldexp(1.0f, w.exponent[k]);
+	}
+
+	w.numChildren = kids.size();
+	for (size_t c = 0; c < kids.size(); c++) {
+		const AABB &box = kids[c]->box;
+
+		// round outwards, and step again if the float decode still falls inside
+		//
+		for (int k = 0; k < 3; k++) {
+			int lo = (int)std::floor((box.min[k] - w.origin[k]) / step[k]);
+			int hi = (int)std::ceil((box.max[k] - w.origin[k]) / step[k]);
+			lo = std::min(std::max(lo, 0), 255);
+			hi = std::min(std::max(hi, 0), 255);
+			while (lo > 0 && w.origin[k] + lo * step[k] > box.min[k]) lo--;
+			while (hi < 255 && w.origin[k] + hi * step[k] < box.max[k]) hi++;
+			w.lo[k][c] = lo;
+			w.hi[k][c] = hi;
+		}
+
+		if (kids[c]->left) {
+			w.count[c] = 0;
+			w.child[c] = collapse(kids[c], tri);
+		}
+		else {
+			// count is a byte: SAH leaves hold at most 4 * maxLeafSize triangles and the
+			// median splits from medianDepth on leave n / 2^20 at maxTreeDepth, so only a
+			// mesh of over 250 million triangles could reach this
+			//
+			assert(kids[c]->count <= 255);
+			w.count[c] = kids[c]->count;
+			w.child[c] = tris.size() / 3;
+			for (int i = kids[c]->start; i < kids[c]->start + kids[c]->count; i++)
+				for (int j = 0; j < 3; j++)
+					tris.push_back(tri[3 * indices[i] + j]);
+		}
+	}
+
+	wnodes[n] = w;
+	return n;
+}
+
+
+// // // TRAVERSAL // // //
+
+
+//  ***
+//  Moller-Trumbore for one triangle of tris, front facing only (like intersectBlock)
+//
+static inline bool intersectTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2,
+									 const glm::vec3 &p, const glm::vec3 &d, float near_t, float &t) {
+	glm::vec3 e1 = v1 - v0, e2 = v2 - v0;
+	glm::vec3 pv = glm::cross(d, e2);
+	float det = glm::dot(e1, pv);
+	if (det <= std::numeric_limits<float>::epsilon()) return false;
+
+	float inv = 1.0f / det;
+	glm::vec3 s = p - v0;
+	float u = glm::dot(s, pv) * inv;
+	if (u < 0 || u > 1) return false;
+
+	glm::vec3 qv = glm::cross(s, e1);
+	float v = glm::dot(d, qv) * inv;
+	if (v < 0 || u + v > 1) return false;
+
+	t = glm::dot(e2, qv) * inv;
+	return (t >= 0 && t < near_t);
+}
+
+
+//  ***
+//  closest (or, with anyHit, first) hit in the compact layouts before tMax
+//  children are decoded from their quantized boxes and pushed far to near,
+//  leaves go on the same stack with their entry distance
+//
+bool MeshBVH::traverseWide(const glm::vec3 &p, const glm::vec3 &d, float tMax, bool anyHit,
+						   float &t, int &face, glm::vec3 &normal) const {
+	if (wnodes.empty()) return false;
+
+	struct Entry { int index, count; float t; };
+	Entry stack[512];
+	int top = 0;
+	stack[top++] = { 0, 0, 0 };
+
+	glm::vec3 invD = 1.0f / d;
+	float near_t = tMax;
+	int hitTri = -1;
+
+	while (top) {
+		Entry e = stack[--top];
+		if (e.t >= near_t) continue;
+
+		if (e.count) {
+			for (int i = e.index; i < e.index + e.count; i++) {
+				float ti;
+				if (intersectTriangle(vertex(tris[3 * i]), vertex(tris[3 * i + 1]), vertex(tris[3 * i + 2]), p, d, near_t, ti)) {
+					near_t = ti;
+					hitTri = i;
+					if (anyHit) return true;
+				}
+			}
+			continue;
+		}
+
+		const WideNode &node = wnodes[e.index];
+		float step[3];
+		for (int k = 0; k < 3; k++) step[k] = std::ldexp(1.0f, node.exponent[k]);
+
+		Entry hits[8];
+		int n = 0;
+		for (int c = 0; c < node.numChildren; c++) {
+			AABB box;
+			for (int k = 0; k < 3; k++) {
+				box.min[k] = node.origin[k] + node.lo[k][c] * step[k];
+				box.max[k] = node.origin[k] + node.hi[k][c] * step[k];
+			}
+
+			float tEntry;
+			if (!box.intersect(p, invD, near_t, tEntry)) continue;
+
+			// insertion sort, farthest first
+			//
+			int j = n++;
+			while (j > 0 && hits[j - 1].t < tEntry) {
+				hits[j] = hits[j - 1];
+				j--;
+			}
+			hits[j] = { node.child[c], node.count[c], tEntry };
+		}
+
+		for (int c = 0; c < n; c++) stack[top++] = hits[c];
+	}
+
+	if (hitTri < 0) return false;
+
+	glm::vec3 v0 = vertex(tris[3 * hitTri]);
+	t = near_t;
+	face = hitTri;
+	normal = glm::normalize(glm::cross(vertex(tris[3 * hitTri + 1]) - v0, vertex(tris[3 * hitTri + 2]) - v0));
+	return true;
+}
@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+#   Andie Sanchez
+#   2 February 2019
+#
+#   start render workers on this machine for distributed animation renders
+#
+#   usage: ./start_workers.sh [workers] [host] [port] [threads per worker]
+#
+#   defaults: 2 workers connecting to 127.0.0.1 on port 11999, sharing the cores
+#   evenly; APP overrides the executable (bin/RayTraceAnimation by default)
+#   the workers keep reconnecting until they are stopped with Ctrl+C
+#
+
+WORKERS=${1:-2}
+HOST=${2:-127.0.0.1}
+PORT=${3:-11999}
+CORES=$(nproc 2>/dev/null || echo 1)
+THREADS=${4:-$(( CORES / WORKERS > 0 ? CORES / WORKERS : 1 ))}
+APP=${APP:-"$(dirname "$0")/bin/RayTraceAnimation"}
+
+if [ ! -x "$APP" ]; then
+	echo "cannot run $APP, build the project first or set APP" >&2
+	exit 1
+fi
+
+PIDS=""
+trap 'kill $PIDS 2>/dev/null; exit 0' INT TERM
+
+i=0
+while [ $i -lt "$WORKERS" ]; do
+	"$APP" --worker "$HOST" "$PORT" "$THREADS" > "worker_$i.log" 2>&1 &
+	PIDS="$PIDS $!"
+	i=$(( i + 1 ))
+done
+
+echo "$WORKERS workers with $THREADS threads each, logs in worker_N.log, Ctrl+C stops them"
+wait